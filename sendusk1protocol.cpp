@@ -1,32 +1,69 @@
 #include "sendusk1protocol.h"
 #include "senduskv1global.h"
+#include "usk1timesyncscheduler.h"
 
 #include <QSerialPort>
-#include <QTimer>
+#ifdef Q_OS_LINUX
+#include "usk1nativeserialport.h"
+#endif
 #include <QDebug>
 
 using namespace SendUSKv1Namespace;
 
-#define waitForRemainingDataTimeout 250
-#define waitResponseTimeout 1500
+#define responsePacketSize 5
 #define sendTimePeriod 60000
+// старт + 8 бит данных + стоп
+#define bitsPerCharacter 10
+#define defaultReadLatencyAllowance 5
+#define defaultCircuitBreakerThreshold 3
+#define initialProbeInterval 1000
+#define maxProbeInterval 30000
+// заполнение очереди (в процентах от ограничения), при котором
+// сообщается о перегрузке и о её окончании
+#define queueCongestionOnPercent 75
+#define queueCongestionOffPercent 50
+// верхняя граница sizeof(SendUsk1Protocol) - тысячи УСК в одном процессе
+#define perUskMemoryBudget 2048
+// сколько ждать сообщения о перезапуске УСК после подтверждённой команды сброса
+#define defaultResetConfirmationTimeout 10000
+// периодическая синхронизация не нужна, если часы подтверждены меньше полупериода назад
+#define timeSyncFreshness (sendTimePeriod / 2)
+// сколько периодов подряд синхронизация может уступать исполнительным командам
+#define maxBusyTimeSyncSkips 4
 
 
+Q_STATIC_ASSERT_X(sizeof(void *) != 8 || sizeof(SendUsk1Protocol) <= perUskMemoryBudget,
+                  "per-USK memory budget exceeded");
+
 SendUsk1Protocol::SendUsk1Protocol(QObject *parent) :
     QObject(parent),
     m_serialPort(nullptr),
-    m_timer(new QTimer(this)),
-    m_timerForCheckOutgoingPackets(new QTimer(this)),
-    m_timerForSendTime(new QTimer(this)),
     m_currentUskState(waitData),
-    m_incomingCommandFactory(new Usk1IncomingCommandFactory(this)),
-    m_attempts(3)
+    m_incomingCommandFactory(nullptr),
+    m_attempts(3),
+    m_uskNum(0),
+    m_baudRate(9600),
+    m_nativeSerialBackend(false),
+    m_readLatencyAllowanceNs(defaultReadLatencyAllowance * 1000000LL),
+    m_lastReadTimeNs(0),
+    m_resyncDiscardedBytes(0),
+    m_suppressRedundantCommands(false),
+    m_sendTimeNs(0),
+    m_writeCompleteNs(0),
+    m_retransmitted(false),
+    m_circuitBreakerThreshold(defaultCircuitBreakerThreshold),
+    m_consecutiveFailures(0),
+    m_circuitOpen(false),
+    m_probeInterval(initialProbeInterval),
+    m_queueCongested(false),
+    m_resetConfirmationTimeout(defaultResetConfirmationTimeout),
+    m_resetStartNs(0),
+    m_lastExchangeEndNs(0),
+    m_receiveErrorHandled(false),
+    m_clockConfirmedNs(-1),
+    m_busyTimeSyncSkips(0)
 {
-    connect(m_timer, SIGNAL(timeout()), this, SLOT(onTimerTimeout()));
-    connect(m_timerForCheckOutgoingPackets, SIGNAL(timeout()),
-            this, SLOT(checkOutgoingBuffer()));
-    connect(m_timerForSendTime, SIGNAL(timeout()),
-            this, SLOT(onSendTimeTimeout()));
+    m_clock.start();
 }
 
 SendUsk1Protocol::~SendUsk1Protocol()
@@ -47,6 +84,7 @@ void SendUsk1Protocol::setUskName(const QString &uskName)
 void SendUsk1Protocol::setUskNum(const int uskNum)
 {
     m_uskNum = uskNum;
+    m_voltageFrames.setUskNum(uskNum);
 }
 
 QString SendUsk1Protocol::getUskName() const
@@ -68,31 +106,170 @@ int SendUsk1Protocol::getUskStatus() const
     return retVal;
 }
 
+const Usk1LinkStatistics &SendUsk1Protocol::statistics() const
+{
+    return m_statistics;
+}
+
+int SendUsk1Protocol::smoothedRtt() const
+{
+    return m_rttEstimator.smoothedRtt();
+}
+
+int SendUsk1Protocol::rttVariation() const
+{
+    return m_rttEstimator.rttVariation();
+}
+
+int SendUsk1Protocol::responseTimeout() const
+{
+    return m_rttEstimator.responseTimeout();
+}
+
 void SendUsk1Protocol::setAttemptsCount(const int attempts)
 {
     m_attempts = attempts;
 }
 
+void SendUsk1Protocol::setBaudRate(const int baudRate)
+{
+    if (baudRate <= 0) {
+        return;
+    }
+    m_baudRate = baudRate;
+    // открытый порт перенастраивается сразу: паузы между пакетами считаются по этой скорости
+    if (QSerialPort *serialPort = qobject_cast<QSerialPort *>(m_serialPort)) {
+        serialPort->setBaudRate(m_baudRate);
+    }
+#ifdef Q_OS_LINUX
+    if (Usk1NativeSerialPort *serialPort = qobject_cast<Usk1NativeSerialPort *>(m_serialPort)) {
+        serialPort->setBaudRate(m_baudRate);
+    }
+#endif
+}
+
+void SendUsk1Protocol::setNativeSerialBackend(const bool enabled)
+{
+    m_nativeSerialBackend = enabled;
+}
+
+void SendUsk1Protocol::setResponseTimeoutBounds(const int minTimeout, const int maxTimeout)
+{
+    m_rttEstimator.setBounds(minTimeout, maxTimeout);
+}
+
+void SendUsk1Protocol::setReadLatencyAllowance(const int msec)
+{
+    m_readLatencyAllowanceNs = qMax(0, msec) * 1000000LL;
+}
+
+void SendUsk1Protocol::setCommandPriority(const int commandType, const int priority)
+{
+    m_outgoingQueue.setPriority(commandType, priority);
+}
+
+void SendUsk1Protocol::setPriorityAgingInterval(const int msec)
+{
+    m_outgoingQueue.setAgingInterval(msec);
+}
+
+void SendUsk1Protocol::setCommandLifetime(const int commandType, const int msec)
+{
+    m_outgoingQueue.setLifetime(commandType, msec);
+}
+
+void SendUsk1Protocol::setQueueLimits(const int maxCommands, const int maxBytes)
+{
+    m_outgoingQueue.setLimits(maxCommands, maxBytes);
+    updateQueueCongestion(false);
+}
+
+void SendUsk1Protocol::setQueueOverflowPolicy(const int policy)
+{
+    m_outgoingQueue.setOverflowPolicy(policy);
+}
+
+int SendUsk1Protocol::queuedCommands() const
+{
+    return m_outgoingQueue.count();
+}
+
+int SendUsk1Protocol::queuedBytes() const
+{
+    return m_outgoingQueue.bytes();
+}
+
+const Usk1OutgoingCommandPool &SendUsk1Protocol::commandPool() const
+{
+    return m_commandPool;
+}
+
+void SendUsk1Protocol::setSuppressRedundantCommands(const bool suppress)
+{
+    m_suppressRedundantCommands = suppress;
+}
+
+void SendUsk1Protocol::setCircuitBreakerThreshold(const int failures)
+{
+    m_circuitBreakerThreshold = qMax(0, failures);
+}
+
+bool SendUsk1Protocol::isCircuitOpen() const
+{
+    return m_circuitOpen;
+}
+
+void SendUsk1Protocol::setResetConfirmationTimeout(const int msec)
+{
+    m_resetConfirmationTimeout = qMax(0, msec);
+}
+
+bool SendUsk1Protocol::isWaitingForReset() const
+{
+    return m_currentUskState == waitIncomingCommand;
+}
+
+void SendUsk1Protocol::setTransmitPacing(const int initialGap, const int maxGap, const int decreaseStep)
+{
+    m_pacer.setBounds(initialGap, maxGap);
+    m_pacer.setDecreaseStep(decreaseStep);
+}
+
+int SendUsk1Protocol::transmitGap() const
+{
+    return m_pacer.gap();
+}
+
 bool SendUsk1Protocol::openUsk()
 {
     if (m_serialPort) {
         return true;
     }
-    m_serialPort = new QSerialPort(m_portName, this);
+    m_serialPort = createSerialPort();
+    m_confirmedStates.clear();
+    m_rttEstimator.reset();
+    m_pacer.reset();
+    m_receiveErrorHandled = false;
+    closeCircuit();
     m_firstUse = true;
     m_uskIsPresent = false;
     bool res = m_serialPort->open(QIODevice::ReadWrite);
     if (!res) return res;
-    if (m_serialPort->setDataBits(QSerialPort::Data8) &&
-            m_serialPort->setBaudRate(9600) &&
-            m_serialPort->setStopBits(QSerialPort::OneStop) &&
-            m_serialPort->setFlowControl(QSerialPort::NoFlowControl) &&
-            m_serialPort->setParity(QSerialPort::NoParity)) {
+    if (configureSerialPort()) {
         connect(m_serialPort, SIGNAL(readyRead()),
                 this, SLOT(onReadyRead()));
+        connect(m_serialPort, SIGNAL(bytesWritten(qint64)),
+                this, SLOT(onBytesWritten()));
+        // одинаковый сигнал у QSerialPort и собственного порта; в очередь - порт
+        // закрывается уже не изнутри его read()/write()
+        qRegisterMetaType<QSerialPort::SerialPortError>("QSerialPort::SerialPortError");
+        connect(m_serialPort, SIGNAL(errorOccurred(QSerialPort::SerialPortError)),
+                this, SLOT(onSerialPortError(QSerialPort::SerialPortError)), Qt::QueuedConnection);
         emit portIsOpen(m_uskName, m_portName);
-        m_timerForCheckOutgoingPackets->start(200);
-        m_timerForSendTime->start(sendTimePeriod);
+        // периодические синхронизации УСК потока разнесены по периоду, а не идут залпом
+        m_clockConfirmedNs = -1;
+        m_busyTimeSyncSkips = 0;
+        m_timerForSendTime.start(Usk1TimeSyncScheduler::forCurrentThread()->nextPhase(sendTimePeriod), this);
         sendTime(QDateTime::currentDateTime());
         res = true;
 
@@ -103,51 +280,153 @@ bool SendUsk1Protocol::openUsk()
         m_serialPort = nullptr;
     }
     m_buffer.clear();
+    m_resyncDiscardedBytes = 0;
     return res;
 }
 
 void SendUsk1Protocol::closeUsk()
 {
-    m_timer->stop();
-    m_timerForCheckOutgoingPackets->stop();
-    m_timerForSendTime->stop();
+    m_timer.stop();
+    m_frameTimer.stop();
+    m_timerForSendTime.stop();
+    m_paceTimer.stop();
+    closeCircuit();
+    if (m_currentUskState == waitIncomingCommand || m_currentUskState == waitTime) {
+        m_currentUskState = waitData;
+    }
     if (!m_serialPort) {
         return;
     }
-    QString portName = m_serialPort->portName();
+    // отклик на передаваемую команду через закрытый порт уже не придёт
+    if (m_currentUskState == waitResponse) {
+        if (m_currentCommand && m_currentCommand->needToInformAboutStartSending()) {
+            emit errorOnSendingCommand(m_uskName, m_currentCommand->description());
+        }
+        m_currentCommand = Usk1OutgoingCommandSharedPtr(nullptr);
+        m_currentUskState = waitData;
+    }
+    m_confirmedStates.clear();
     m_serialPort->close();
     m_serialPort->deleteLater();
-    emit portIsClose(m_uskName, portName);
+    m_serialPort = nullptr;
+    emit portIsClose(m_uskName, m_portName);
 }
 
 void SendUsk1Protocol::sendTime(const QDateTime &time)
 {
-    auto cmd = new SendTimeUsk1OutgoingCommand(m_serialPort, m_uskNum, m_attempts, time);
-    m_outgoingCommnads.append(Usk1OutgoingCommandSharedPtr(cmd));
+    auto cmd = new (m_commandPool) SendTimeUsk1OutgoingCommand(m_serialPort, m_uskNum, m_attempts, time);
+    enqueueCommand(Usk1OutgoingCommandSharedPtr(cmd));
 }
 
 void SendUsk1Protocol::sendMessage(const QString &message)
 {
-    auto cmd = new SendMessageUsk1OutgoingCommand(m_serialPort, m_uskNum, m_attempts, message);
-    m_outgoingCommnads.append(Usk1OutgoingCommandSharedPtr(cmd));
+    auto cmd = new (m_commandPool) SendMessageUsk1OutgoingCommand(m_serialPort, m_uskNum, m_attempts, message);
+    enqueueCommand(Usk1OutgoingCommandSharedPtr(cmd));
 }
 
 void SendUsk1Protocol::resetUsk()
 {
-    auto cmd = new ResetUsk1OutgoingCommand(m_serialPort, m_uskNum, m_attempts);
-    m_outgoingCommnads.append(Usk1OutgoingCommandSharedPtr(cmd));
+    auto cmd = new (m_commandPool) ResetUsk1OutgoingCommand(m_serialPort, m_uskNum, m_attempts);
+    enqueueCommand(Usk1OutgoingCommandSharedPtr(cmd));
 }
 
 void SendUsk1Protocol::changeRelayStatus(const int &rayNum, const int &kpuNum, const int &sensorNum, const int &relayStatus, const QString &sensorName)
 {
-    auto cmd = new ChangeRelayUsk1OutgoingCommand(m_serialPort, m_uskNum, m_attempts, rayNum, kpuNum, sensorNum, relayStatus, sensorName);
-    m_outgoingCommnads.append(Usk1OutgoingCommandSharedPtr(cmd));
+    auto cmd = new (m_commandPool) ChangeRelayUsk1OutgoingCommand(m_serialPort, m_uskNum, m_attempts, rayNum, kpuNum, sensorNum, relayStatus, sensorName);
+    enqueueCommand(Usk1OutgoingCommandSharedPtr(cmd));
 }
 
 void SendUsk1Protocol::changeVoltageStatus(const int numOutput, const bool &on)
 {
-    auto cmd = new ChangeVoltageUsk1OutgoingCommand(m_serialPort, m_uskNum, m_attempts, numOutput, on);
-    m_outgoingCommnads.append(Usk1OutgoingCommandSharedPtr(cmd));
+    auto cmd = new (m_commandPool) ChangeVoltageUsk1OutgoingCommand(m_serialPort, m_uskNum, m_attempts, numOutput, on,
+                                                                    m_voltageFrames);
+    enqueueCommand(Usk1OutgoingCommandSharedPtr(cmd));
+}
+
+void SendUsk1Protocol::enqueueCommand(const Usk1OutgoingCommandSharedPtr &command)
+{
+    if (m_circuitOpen) {
+        if (command->needToInformAboutStartSending()) {
+            emit commandDiscarded(m_uskName, command->description(), discardUskUnavailable);
+        }
+        return;
+    }
+    if (m_suppressRedundantCommands && isRedundantCommand(command)) {
+        // состояние уже такое - ни новая, ни ожидающая в очереди команда не нужны
+        const Usk1OutgoingCommandSharedPtr pending = m_outgoingQueue.take(command->coalescingKey());
+        if (pending && pending->needToInformAboutStartSending()) {
+            emit commandDiscarded(m_uskName, pending->description(), discardCoalesced);
+        }
+        // запрошенное состояние уже подтверждено - команда выполнена без обмена с УСК
+        if (command->needToInformAboutStartSending()) {
+            emit commandAccepted(m_uskName, command->description());
+        }
+        return;
+    }
+    Usk1OutgoingCommandSharedPtrList coalesced;
+    Usk1OutgoingCommandSharedPtrList dropped;
+    const bool accepted = m_outgoingQueue.enqueue(command, m_clock.elapsed(), &coalesced, &dropped);
+    for (const Usk1OutgoingCommandSharedPtr &superseded : coalesced) {
+        if (superseded->needToInformAboutStartSending()) {
+            emit commandDiscarded(m_uskName, superseded->description(), discardCoalesced);
+        }
+    }
+    if (!accepted) {
+        dropped.append(command);
+    }
+    for (const Usk1OutgoingCommandSharedPtr &overflow : dropped) {
+        ++m_statistics.overflowCommands;
+        if (overflow->needToInformAboutStartSending()) {
+            emit commandDiscarded(m_uskName, overflow->description(), discardQueueOverflow);
+        }
+    }
+    m_statistics.queueHighWaterCommands = qMax(m_statistics.queueHighWaterCommands, m_outgoingQueue.count());
+    m_statistics.queueHighWaterBytes = qMax(m_statistics.queueHighWaterBytes, m_outgoingQueue.bytes());
+    updateQueueCongestion(!dropped.isEmpty());
+    checkOutgoingBuffer();
+}
+
+void SendUsk1Protocol::updateQueueCongestion(const bool overflow)
+{
+    const int maxCommands = m_outgoingQueue.maxCommands();
+    const int maxBytes = m_outgoingQueue.maxBytes();
+    const qint64 commandsPercent = maxCommands > 0 ? m_outgoingQueue.count() * 100LL / maxCommands : 0;
+    const qint64 bytesPercent = maxBytes > 0 ? m_outgoingQueue.bytes() * 100LL / maxBytes : 0;
+    const qint64 fill = qMax(commandsPercent, bytesPercent);
+    // гистерезис, чтобы сигнал не дребезжал на границе
+    bool congested = m_queueCongested;
+    if (overflow || fill >= queueCongestionOnPercent) {
+        congested = true;
+    } else if (fill <= queueCongestionOffPercent) {
+        congested = false;
+    }
+    if (congested != m_queueCongested) {
+        m_queueCongested = congested;
+        emit queueCongested(m_uskName, congested);
+    }
+}
+
+bool SendUsk1Protocol::isRedundantCommand(const Usk1OutgoingCommandSharedPtr &command) const
+{
+    const int state = command->targetState();
+    const quint64 key = command->coalescingKey();
+    if (state < 0 || key == 0) {
+        return false;
+    }
+    // команда для той же цели уже передаётся - её результат ещё неизвестен
+    if (m_currentCommand && m_currentCommand->coalescingKey() == key) {
+        return false;
+    }
+    return m_confirmedStates.value(key, -1) == state;
+}
+
+void SendUsk1Protocol::registerIncomingCommand(const int priority, Usk1IncomingCommand *command)
+{
+    // общие таблицы неизменяемы - свои команды регистрируются поверх них
+    if (!m_incomingCommandFactory) {
+        m_incomingCommandFactory = new Usk1IncomingCommandFactory(&Usk1IncomingCommandFactory::defaultFactory());
+    }
+    m_incomingCommandFactory->registerCommand(priority, command);
 }
 
 void SendUsk1Protocol::onUnknowCommand(const QString &command)
@@ -162,8 +441,13 @@ void SendUsk1Protocol::onError(int errorCode)
 
 void SendUsk1Protocol::onResetUskCommand()
 {
+    m_confirmedStates.clear();
+    m_clockConfirmedNs = -1;
     emit uskReset(m_uskName);
     emit uskInfoPacketReceived(m_uskName, packetUskReset);
+    if (m_currentUskState == waitIncomingCommand) {
+        finishResetWait(true);
+    }
 }
 
 void SendUsk1Protocol::onReceivedTextMessage(const QString &textMessage)
@@ -183,81 +467,222 @@ void SendUsk1Protocol::onDetectedDisconnetcedKpu(const int &rayNum, const int &k
 
 void SendUsk1Protocol::onVoltageStatusChanged(const int &outputNumber, const bool &status)
 {
+    m_confirmedStates[ChangeVoltageUsk1OutgoingCommand::targetKey(outputNumber)] = status ? 1 : 0;
     emit voltageStatusChanged(m_uskName, outputNumber, status);
 }
 
 void SendUsk1Protocol::onSensorChanged(const int &rayNum, const int &kpuNum, const int &sensorNum, const int &state)
 {
+    m_confirmedStates[ChangeRelayUsk1OutgoingCommand::targetKey(rayNum, kpuNum, sensorNum)] = state ? 1 : 0;
     emit sensorChanged(m_uskName, rayNum, kpuNum, sensorNum, state);
 }
 
 void SendUsk1Protocol::onUskInfoPacketReceived(const int &infoPacket)
 {
     emit uskInfoPacketReceived(m_uskName, infoPacket);
+    if (infoPacket == packetUskErrorReceivingRS) {
+        onReceiveErrorReported();
+    } else if (infoPacket == packetUskSettingTime) {
+        m_clockConfirmedNs = m_clock.nsecsElapsed();
+    }
+    if (infoPacket == packetUskOn && m_currentUskState == waitIncomingCommand) {
+        finishResetWait(true);
+    }
 }
 
-void SendUsk1Protocol::parseIncomingData()
+void SendUsk1Protocol::parseIncomingData(const bool frameComplete)
 {
-    qDebug() << Q_FUNC_INFO << m_buffer.length();
-    switch (m_currentUskState) {
-    case waitData:
-    case waitIncomingCommand:
-    case waitTime:
-    {
-        m_currentUskState = waitData;
-        // входящая команда
-        while (m_buffer.length() >= 26) {
-            QByteArray packet = m_buffer.left(26);
-            m_buffer.remove(0, 26);
-            Usk1IncomingCommandSharedPtr cmd = m_incomingCommandFactory->getCommandByPacket(packet);
-            if (cmd) {
-                cmd->informAboutCommand();
-                if (!m_uskIsPresent && cmd->isCorrectPacket()) {
-                    emitUskIsPresent(true);
+    // входящие команды (26 байт) и отклики (5 байт) различаем по содержимому,
+    // а не по состоянию: УСК может прислать событие раньше отклика
+    while (!m_buffer.isEmpty()) {
+        if (m_buffer.size() >= Usk1IncomingPacket::PacketSize) {
+            char scratch[Usk1IncomingPacket::PacketSize];
+            const Usk1IncomingPacket packet(m_buffer.peek(Usk1IncomingPacket::PacketSize, scratch),
+                                            Usk1IncomingPacket::PacketSize);
+            if (isPacketInSync(packet)) {
+                reportResync();
+                closeCircuit();
+                const Usk1IncomingCommand *cmd = incomingCommandFactory().getCommandByPacket(packet);
+                if (cmd) {
+                    cmd->informAboutCommand(this, packet);
+                    if (!m_uskIsPresent) {
+                        emitUskIsPresent(true);
+                        m_uskIsPresent = true;
+                    }
                 }
+                m_buffer.skip(Usk1IncomingPacket::PacketSize);
+                continue;
             }
         }
-        if (m_buffer.length() > 0) {
+        if (m_buffer.size() >= responsePacketSize) {
+            char scratch[responsePacketSize];
+            if (isCorrectResponse(m_buffer.peek(responsePacketSize, scratch))) {
+                if (m_currentUskState == waitResponse) {
+                    // начало пакета этого УСК тоже может сойтись как отклик -
+                    // ждём остальные байты пакета или паузу t3.5
+                    if (!frameComplete && m_buffer.size() < Usk1IncomingPacket::PacketSize &&
+                            isPacketPrefixInSync()) {
+                        break;
+                    }
+                    const bool matched = isResponseToCurrentCommand();
+                    m_buffer.skip(responsePacketSize);
+                    if (matched) {
+                        reportResync();
+                        onResponseReceived();
+                    } else {
+                        ++m_statistics.unmatchedResponses;
+                    }
+                    continue;
+                }
+                if (frameComplete || m_buffer.size() >= Usk1IncomingPacket::PacketSize) {
+                    // запоздавший отклик на команду, по которой уже истёк таймаут
+                    m_buffer.skip(responsePacketSize);
+                    ++m_statistics.unmatchedResponses;
+                    continue;
+                }
+            }
+        }
+        if (m_buffer.size() < Usk1IncomingPacket::PacketSize) {
             // надо что-то допринять
-            m_timer->start(waitForRemainingDataTimeout);
+            break;
         }
+        // потеряна граница пакета - сдвигаемся на байт, пока не сойдутся
+        // контрольная сумма и номер УСК
+        m_buffer.skip(1);
+        ++m_resyncDiscardedBytes;
+        ++m_statistics.discardedBytes;
     }
+    if (m_buffer.isEmpty()) {
+        checkOutgoingBuffer();
+    } else if (frameComplete) {
+        dropIncompleteFrame(m_clock.nsecsElapsed() - m_lastReadTimeNs);
+    } else {
+        startFrameTimer();
+    }
+}
 
-        break;
-    case waitResponse: {
-        // отклик (5 байт)
-        if (m_buffer.length() < 5) {
-            m_timer->start(waitForRemainingDataTimeout);
-            return;
-        }
-        m_currentUskState = waitData;
-        QByteArray packet = m_buffer.left(5);
-        m_buffer.remove(0, 5);
-        char crc = 0;
-        for (int i = 0; i < 4; ++i) {
-            crc += packet.at(i);
-        }
-        if (crc != packet.at(4)) {
-            error(m_uskName, errorUskWrongPacket);
-        }
-        if (m_currentCommand && m_currentCommand->needToInformAboutStartSending()){
-            emit commandAccepted(m_uskName, m_currentCommand->description());
-        }
-        if (!m_uskIsPresent){
-            emitUskIsPresent(true);
-            m_uskIsPresent = true;
-        }
-        m_currentCommand = Usk1OutgoingCommandSharedPtr(nullptr);
+const Usk1IncomingCommandFactory &SendUsk1Protocol::incomingCommandFactory() const
+{
+    return m_incomingCommandFactory ? *m_incomingCommandFactory : Usk1IncomingCommandFactory::defaultFactory();
+}
 
-        if (m_buffer.length() > 0) {
-            parseIncomingData();
-            return;
+bool SendUsk1Protocol::isCorrectResponse(const char *response) const
+{
+    char crc = 0;
+    for (int i = 0; i < responsePacketSize - 1; ++i) {
+        crc += response[i];
+    }
+    return crc == response[responsePacketSize - 1];
+}
+
+bool SendUsk1Protocol::isResponseToCurrentCommand() const
+{
+    // УСК отвечает только после приёма всего кадра: отклик, закончившийся раньше,
+    // чем текущая попытка могла дойти до УСК, относится к прежней команде.
+    // Байты после отклика пришли позже него - по ним оцениваем его конец сверху
+    if (!m_currentCommand) {
+        return false;
+    }
+    const qint64 charNs = characterTimeNs();
+    const qint64 responseEndNs = m_lastReadTimeNs - (m_buffer.size() - responsePacketSize) * charNs;
+    const qint64 earliestEndNs = m_sendTimeNs + (Usk1OutgoingCommand::FrameSize + responsePacketSize) * charNs;
+    return responseEndNs >= earliestEndNs;
+}
+
+void SendUsk1Protocol::onResponseReceived()
+{
+    m_timer.stop();
+    m_currentUskState = waitData;
+    if (m_currentCommand && !m_retransmitted) {
+        const qint64 start = m_writeCompleteNs ? m_writeCompleteNs : m_sendTimeNs;
+        m_rttEstimator.addSample((m_clock.nsecsElapsed() - start) / 1000);
+    }
+    m_rttEstimator.onSuccess();
+    if (m_currentCommand && !m_retransmitted) {
+        m_pacer.onCleanResponse();
+    }
+    m_lastExchangeEndNs = m_clock.nsecsElapsed();
+    closeCircuit();
+    bool resetAccepted = false;
+    if (m_currentCommand) {
+        if (m_currentCommand->commandType() == commandReset) {
+            m_confirmedStates.clear();
+            m_clockConfirmedNs = -1;
+            resetAccepted = m_currentCommand->needToWaitCommand();
+        } else if (m_currentCommand->commandType() == commandSendTime) {
+            m_clockConfirmedNs = m_clock.nsecsElapsed();
+        } else if (m_currentCommand->targetState() >= 0) {
+            m_confirmedStates[m_currentCommand->coalescingKey()] = m_currentCommand->targetState();
         }
     }
-        break;
-    default:
-        break;
+    if (m_currentCommand && m_currentCommand->needToInformAboutStartSending()){
+        emit commandAccepted(m_uskName, m_currentCommand->description());
+    }
+    if (!m_uskIsPresent){
+        emitUskIsPresent(true);
+        m_uskIsPresent = true;
+    }
+    m_currentCommand = Usk1OutgoingCommandSharedPtr(nullptr);
+    if (resetAccepted) {
+        startResetWait();
     }
+    checkOutgoingBuffer();
+}
+
+void SendUsk1Protocol::startResetWait()
+{
+    // УСК перезагружается: команды, отправленные сейчас, пропадут -
+    // очередь стоит до сообщения о сбросе/включении УСК или до таймаута
+    if (m_resetConfirmationTimeout == 0) {
+        return;
+    }
+    ++m_statistics.resetWaits;
+    m_resetStartNs = m_clock.nsecsElapsed();
+    m_currentUskState = waitIncomingCommand;
+    m_timer.start(m_resetConfirmationTimeout, this);
+}
+
+void SendUsk1Protocol::finishResetWait(const bool confirmed)
+{
+    m_timer.stop();
+    m_currentUskState = waitData;
+    m_statistics.lastResetRecoveryMs = (m_clock.nsecsElapsed() - m_resetStartNs) / 1000000;
+    m_statistics.maxResetRecoveryMs = qMax(m_statistics.maxResetRecoveryMs, m_statistics.lastResetRecoveryMs);
+    if (!confirmed) {
+        ++m_statistics.resetWaitTimeouts;
+        emit error(m_uskName, errorUskResetNotConfirmed);
+    }
+    // часы УСК после перезапуска неверны - синхронизируем сразу, не дожидаясь периода;
+    // фаза периодической синхронизации при этом сохраняется
+    if (m_serialPort && m_serialPort->isOpen()) {
+        sendTime(QDateTime::currentDateTime());
+    } else {
+        checkOutgoingBuffer();
+    }
+}
+
+void SendUsk1Protocol::reportResync()
+{
+    if (m_resyncDiscardedBytes > 0) {
+        m_resyncDiscardedBytes = 0;
+        ++m_statistics.resyncCount;
+        emit error(m_uskName, errorUskPacketResync);
+    }
+}
+
+bool SendUsk1Protocol::isPacketInSync(const Usk1IncomingPacket &packet) const
+{
+    return packet.isCorrectPacket() && packet.uskNumber() == m_uskNum;
+}
+
+bool SendUsk1Protocol::isPacketPrefixInSync() const
+{
+    // пакет начинается с номера УСК (младший байт первым)
+    char scratch[2];
+    const int size = qMin(m_buffer.size(), 2);
+    const uchar *prefix = reinterpret_cast<const uchar *>(m_buffer.peek(size, scratch));
+    return size > 0 && prefix[0] == (m_uskNum & 0xff) &&
+            (size < 2 || prefix[1] == ((m_uskNum >> 8) & 0xff));
 }
 
 void SendUsk1Protocol::emitUskIsPresent(const bool isPresent)
@@ -268,54 +693,137 @@ void SendUsk1Protocol::emitUskIsPresent(const bool isPresent)
 
 void SendUsk1Protocol::onReadyRead()
 {
-    QSerialPort *serialPort = qobject_cast<QSerialPort*>(sender());
+    QIODevice *serialPort = qobject_cast<QIODevice*>(sender());
     if (!serialPort) {
         return;
     }
-    m_timer->stop();
-    m_buffer.append(serialPort->readAll());
+    m_frameTimer.stop();
+    const qint64 now = m_clock.nsecsElapsed();
+    if (!m_buffer.isEmpty()) {
+        // пауза внутри пакета длиннее t1.5 - недопринятый пакет уже не будет дополнен
+        const qint64 silence = now - m_lastReadTimeNs - serialPort->bytesAvailable() * characterTimeNs();
+        if (silence > interCharacterTimeoutNs() + m_readLatencyAllowanceNs) {
+            parseIncomingData(true);
+        }
+    }
+    m_lastReadTimeNs = now;
+    forever {
+        int contiguous = 0;
+        char *data = m_buffer.writePointer(contiguous);
+        if (contiguous == 0) {
+            // буфер заполнен - разбираем принятое и освобождаем место
+            parseIncomingData();
+            data = m_buffer.writePointer(contiguous);
+            if (contiguous == 0) {
+                emit error(m_uskName, errorUskWrongPacket);
+                m_buffer.clear();
+                data = m_buffer.writePointer(contiguous);
+            }
+        }
+        const qint64 bytesRead = serialPort->read(data, contiguous);
+        if (bytesRead <= 0) {
+            break;
+        }
+        m_buffer.commit(static_cast<int>(bytesRead));
+    }
     parseIncomingData();
 }
 
+void SendUsk1Protocol::onBytesWritten()
+{
+    if (m_currentUskState == waitResponse && m_writeCompleteNs == 0 &&
+            m_serialPort && m_serialPort->bytesToWrite() == 0) {
+        m_writeCompleteNs = m_clock.nsecsElapsed();
+    }
+}
+
+void SendUsk1Protocol::onSerialPortError(QSerialPort::SerialPortError serialPortError)
+{
+    // сообщение от уже закрытого порта опоздало
+    if (!m_serialPort || sender() != m_serialPort) {
+        return;
+    }
+    switch (serialPortError) {
+    case QSerialPort::ResourceError:
+    case QSerialPort::ReadError:
+    case QSerialPort::WriteError:
+        break;
+    default:
+        return;
+    }
+    emit error(m_uskName, errorPortFailure);
+    closeUsk();
+}
+
+void SendUsk1Protocol::wheelTimerEvent(Usk1WheelTimer *timer)
+{
+    if (timer == &m_timer) {
+        onTimerTimeout();
+    } else if (timer == &m_frameTimer) {
+        onFrameTimerTimeout();
+    } else if (timer == &m_timerForSendTime) {
+        onSendTimeTimeout();
+    } else if (timer == &m_probeTimer) {
+        onProbeTimerTimeout();
+    } else if (timer == &m_paceTimer) {
+        checkOutgoingBuffer();
+    }
+}
+
 void SendUsk1Protocol::onTimerTimeout()
 {
-    QTimer *timer = qobject_cast<QTimer*>(sender());
-    if (!timer) return;
-    timer->stop();
     switch (m_currentUskState) {
     case waitData:
-    {
-        qDebug() << Q_FUNC_INFO << m_buffer.length();
-        emit error(m_uskName, errorTimeoutWhileWaitData);
-        m_buffer.clear();
-    }
         break;
     case waitIncomingCommand:
+        finishResetWait(false);
+        break;
     case waitTime:
     {
         m_currentUskState = waitData;
+        checkOutgoingBuffer();
     }
         break;
     case waitResponse:
     {
-
-        if (m_buffer.length() == 0) {
-            emit error(m_uskName, errorUskIsntResponse);
-        } else {
-            emit error(m_uskName, errorTimeoutWhileWaitResponse);
+        // пока предохранитель разомкнут, о неответе на пробы не сообщаем
+        if (!m_circuitOpen) {
+            if (m_buffer.isEmpty()) {
+                emit error(m_uskName, errorUskIsntResponse);
+            } else {
+                emit error(m_uskName, errorTimeoutWhileWaitResponse);
+            }
         }
-        m_uskIsPresent = false;
-        emitUskIsPresent(false);
+        if (m_uskIsPresent || m_firstUse) {
+            m_uskIsPresent = false;
+            emitUskIsPresent(false);
+        }
+        // УСК не отвечает - подтверждённые состояния могли устареть
+        m_confirmedStates.clear();
+        m_frameTimer.stop();
+        m_resyncDiscardedBytes = 0;
         m_buffer.clear();
-        if (m_currentCommand && m_currentCommand->isAnotherAttemptPresent()) {
-            m_currentCommand->sendCommand();
-            m_timer->start(waitResponseTimeout);
+        m_rttEstimator.onTimeout();
+        ++m_consecutiveFailures;
+        if (!m_circuitOpen && m_circuitBreakerThreshold > 0 &&
+                m_consecutiveFailures >= m_circuitBreakerThreshold) {
+            openCircuit();
+        }
+        if (!m_circuitOpen && m_currentCommand && m_currentCommand->isAnotherAttemptPresent()) {
+            m_retransmitted = true;
+            sendCurrentCommand();
         } else {
             if (m_currentCommand && m_currentCommand->needToInformAboutStartSending()) {
                 emit errorOnSendingCommand(m_uskName, m_currentCommand->description());
             }
             m_currentCommand = Usk1OutgoingCommandSharedPtr(nullptr);
             m_currentUskState = waitData;
+            m_lastExchangeEndNs = m_clock.nsecsElapsed();
+            if (m_circuitOpen) {
+                scheduleProbe();
+            } else {
+                checkOutgoingBuffer();
+            }
         }
     }
     default:
@@ -323,24 +831,221 @@ void SendUsk1Protocol::onTimerTimeout()
     }
 }
 
+void SendUsk1Protocol::onFrameTimerTimeout()
+{
+    // отложенный из-за похожего на пакет начала отклик разбирается здесь,
+    // остальное отбрасывается как недопринятый пакет
+    if (!m_buffer.isEmpty()) {
+        parseIncomingData(true);
+    }
+}
+
+qint64 SendUsk1Protocol::characterTimeNs() const
+{
+    return bitsPerCharacter * 1000000000LL / m_baudRate;
+}
+
+qint64 SendUsk1Protocol::interCharacterTimeoutNs() const
+{
+    // как в Modbus RTU: на скоростях выше 19200 - фиксированные 750 мкс
+    return m_baudRate > 19200 ? 750000 : characterTimeNs() * 15 / 10;
+}
+
+qint64 SendUsk1Protocol::interFrameTimeoutNs() const
+{
+    return m_baudRate > 19200 ? 1750000 : characterTimeNs() * 35 / 10;
+}
+
+void SendUsk1Protocol::startFrameTimer()
+{
+    // время на доприём самого длинного пакета плюс межпакетная пауза t3.5
+    const int missingBytes = qMax(0, Usk1IncomingPacket::PacketSize - m_buffer.size());
+    const qint64 timeout = missingBytes * characterTimeNs() + interFrameTimeoutNs() + m_readLatencyAllowanceNs;
+    m_frameTimer.start(static_cast<int>((timeout + 999999) / 1000000), this);
+}
+
+void SendUsk1Protocol::dropIncompleteFrame(const qint64 silenceNs)
+{
+    qDebug() << Q_FUNC_INFO << m_buffer.size();
+    emit error(m_uskName, errorTimeoutWhileWaitData);
+    m_statistics.discardedBytes += m_buffer.size();
+    ++m_statistics.incompleteFrames;
+    m_statistics.lastRecoveryTimeMs = silenceNs / 1000000;
+    m_statistics.maxRecoveryTimeMs = qMax(m_statistics.maxRecoveryTimeMs, m_statistics.lastRecoveryTimeMs);
+    m_resyncDiscardedBytes = 0;
+    m_buffer.clear();
+    checkOutgoingBuffer();
+}
+
 void SendUsk1Protocol::checkOutgoingBuffer()
 {
-    if (m_currentUskState == waitData && m_buffer.length() == 0 && m_currentCommand == nullptr && m_outgoingCommnads.count() > 0) {
-        m_currentCommand = m_outgoingCommnads.takeFirst();
+    // отправка по событиям: постановка в очередь, отклик, исчерпание попыток,
+    // освобождение приёмного буфера
+    if (!m_circuitOpen && m_serialPort && m_serialPort->isOpen() && m_currentUskState == waitData && m_buffer.isEmpty() && m_currentCommand == nullptr && !m_outgoingQueue.isEmpty()) {
+        // УСК не успевал принимать - выдерживаем паузу после предыдущего обмена
+        const qint64 gapNs = m_pacer.gap() * 1000000LL;
+        const qint64 sinceExchangeNs = m_clock.nsecsElapsed() - m_lastExchangeEndNs;
+        if (gapNs > sinceExchangeNs) {
+            if (!m_paceTimer.isActive()) {
+                ++m_statistics.pacedCommands;
+                m_paceTimer.start(static_cast<int>((gapNs - sinceExchangeNs + 999999) / 1000000), this);
+            }
+            return;
+        }
+        const qint64 now = m_clock.elapsed();
+        m_currentCommand = m_outgoingQueue.dequeue(now);
+        // просроченные команды снимаются, не занимая линию
+        while (m_currentCommand && m_currentCommand->isExpired(now)) {
+            ++m_statistics.expiredCommands;
+            if (m_currentCommand->needToInformAboutStartSending()) {
+                emit commandDiscarded(m_uskName, m_currentCommand->description(), discardExpired);
+            }
+            m_currentCommand = m_outgoingQueue.dequeue(now);
+        }
+        updateQueueCongestion(false);
         if (m_currentCommand) {
+            Usk1QueueWaitStatistics &wait = m_statistics.queueWait[m_currentCommand->priority()];
+            const qint64 waitMs = now - m_currentCommand->enqueueTime();
+            ++wait.commands;
+            wait.totalWaitMs += waitMs;
+            wait.maxWaitMs = qMax(wait.maxWaitMs, waitMs);
             if (m_currentCommand->needToInformAboutStartSending() && m_currentCommand->isFirstAttempt()) {
                 emit startSendingCommand(m_uskName, m_currentCommand->description());
             }
-            m_currentCommand->sendCommand();
+            m_retransmitted = false;
             m_currentUskState = waitResponse;
-            m_timer->start(waitResponseTimeout);
-        } else {
-            checkOutgoingBuffer();
+            sendCurrentCommand();
         }
     }
 }
 
+void SendUsk1Protocol::sendCurrentCommand()
+{
+    m_sendTimeNs = m_clock.nsecsElapsed();
+    m_writeCompleteNs = 0;
+    m_receiveErrorHandled = false;
+    // команда могла быть создана до переоткрытия порта
+    m_currentCommand->setSerialPort(m_serialPort);
+    m_currentCommand->sendCommand();
+    // таймер взводится сразу, а отклик отсчитывается от конца передачи пакета
+    const qint64 transmitNs = Usk1OutgoingCommand::FrameSize * characterTimeNs();
+    m_timer.start(m_rttEstimator.responseTimeout() + static_cast<int>((transmitNs + 999999) / 1000000), this);
+}
+
 void SendUsk1Protocol::onSendTimeTimeout()
 {
+    m_timerForSendTime.start(sendTimePeriod, this);
+    if (m_clockConfirmedNs >= 0 &&
+            m_clock.nsecsElapsed() - m_clockConfirmedNs < timeSyncFreshness * 1000000LL) {
+        ++m_statistics.timeSyncsSkippedConfirmed;
+        return;
+    }
+    // синхронизация не задерживает исполнительные команды, но и не откладывается бесконечно
+    if (isActuatorTrafficPending() && m_busyTimeSyncSkips < maxBusyTimeSyncSkips) {
+        ++m_busyTimeSyncSkips;
+        ++m_statistics.timeSyncsSkippedBusy;
+        return;
+    }
+    m_busyTimeSyncSkips = 0;
+    ++m_statistics.timeSyncsSent;
     sendTime(QDateTime::currentDateTime());
 }
+
+bool SendUsk1Protocol::isActuatorTrafficPending() const
+{
+    if (m_currentCommand && (m_currentCommand->commandType() == commandChangeRelay ||
+                             m_currentCommand->commandType() == commandChangeVoltage)) {
+        return true;
+    }
+    return m_outgoingQueue.countOfType(commandChangeRelay) > 0 ||
+            m_outgoingQueue.countOfType(commandChangeVoltage) > 0;
+}
+
+QIODevice *SendUsk1Protocol::createSerialPort()
+{
+#ifdef Q_OS_LINUX
+    if (m_nativeSerialBackend) {
+        Usk1NativeSerialPort *serialPort = new Usk1NativeSerialPort(m_portName, this);
+        serialPort->setBaudRate(m_baudRate);
+        return serialPort;
+    }
+#endif
+    return new QSerialPort(m_portName, this);
+}
+
+bool SendUsk1Protocol::configureSerialPort()
+{
+    QSerialPort *serialPort = qobject_cast<QSerialPort *>(m_serialPort);
+    if (!serialPort) {
+        // собственный порт настраивает линию (8N1, скорость) при открытии
+        return true;
+    }
+    return serialPort->setDataBits(QSerialPort::Data8) &&
+            serialPort->setBaudRate(m_baudRate) &&
+            serialPort->setStopBits(QSerialPort::OneStop) &&
+            serialPort->setFlowControl(QSerialPort::NoFlowControl) &&
+            serialPort->setParity(QSerialPort::NoParity);
+}
+
+void SendUsk1Protocol::onProbeTimerTimeout()
+{
+    if (!m_circuitOpen || !m_serialPort || !m_serialPort->isOpen()) {
+        return;
+    }
+    if (m_currentUskState != waitData || !m_buffer.isEmpty() || m_currentCommand) {
+        // линия занята приёмом - проба позже
+        scheduleProbe();
+        return;
+    }
+    // проба - синхронизация времени с одной попыткой: короткая и полезная при ответе
+    ++m_statistics.probeCount;
+    m_currentCommand = Usk1OutgoingCommandSharedPtr(
+                new (m_commandPool) SendTimeUsk1OutgoingCommand(m_serialPort, m_uskNum, 1, QDateTime::currentDateTime()));
+    m_retransmitted = false;
+    m_currentUskState = waitResponse;
+    sendCurrentCommand();
+}
+
+void SendUsk1Protocol::openCircuit()
+{
+    m_circuitOpen = true;
+    m_probeInterval = initialProbeInterval;
+    ++m_statistics.circuitOpenCount;
+    emit error(m_uskName, errorUskCircuitOpen);
+    // ожидающие команды не будут выполнены - сообщаем сразу, не занимая линию
+    const qint64 now = m_clock.elapsed();
+    while (!m_outgoingQueue.isEmpty()) {
+        const Usk1OutgoingCommandSharedPtr command = m_outgoingQueue.dequeue(now);
+        if (command && command->needToInformAboutStartSending()) {
+            emit commandDiscarded(m_uskName, command->description(), discardUskUnavailable);
+        }
+    }
+    updateQueueCongestion(false);
+}
+
+void SendUsk1Protocol::closeCircuit()
+{
+    m_consecutiveFailures = 0;
+    if (!m_circuitOpen) {
+        return;
+    }
+    m_circuitOpen = false;
+    m_probeTimer.stop();
+}
+
+void SendUsk1Protocol::scheduleProbe()
+{
+    m_probeTimer.start(m_probeInterval, this);
+    m_probeInterval = qMin(m_probeInterval * 2, maxProbeInterval);
+}
+
+void SendUsk1Protocol::onReceiveErrorReported()
+{
+    ++m_statistics.receiveErrorReports;
+    if (m_receiveErrorHandled) {
+        return;
+    }
+    m_receiveErrorHandled = true;
+    m_pacer.onReceiveError();
+    m_statistics.maxTransmitGapMs = qMax(m_statistics.maxTransmitGapMs, m_pacer.gap());
+}
@@ -3,14 +3,27 @@
 
 #include <QObject>
 #include <QDateTime>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSerialPort>
 
 #include "usk1outgoingcommand.h"
+#include "usk1outgoingcommandpool.h"
+#include "usk1outgoingqueue.h"
 #include "usk1incomingcommand.h"
+#include "usk1ringbuffer.h"
+#include "usk1rttestimator.h"
+#include "usk1statistics.h"
+#include "usk1timerwheel.h"
+#include "usk1transmitpacer.h"
 
-class QSerialPort;
-class QTimer;
+class QIODevice;
 
-class SendUsk1Protocol : public QObject
+// протокол одного УСК. Бюджет памяти на УСК: объект не больше perUskMemoryBudget
+// (проверяется при сборке) плюс закрытые данные QObject; порт, пул команд и своя
+// фабрика входящих команд появляются только при открытии порта, первой команде
+// и регистрации своей команды, таблицы разбора общие для процесса
+class SendUsk1Protocol : public QObject, public Usk1TimerWheelClient
 {
     Q_OBJECT
     enum States {
@@ -29,8 +42,45 @@ public:
     QString getUskName() const;
     QString getUskPortName() const;
     int getUskStatus() const;
+    const Usk1LinkStatistics &statistics() const;
+    // сглаженное время отклика и его разброс, мс (-1 - ещё не измерено)
+    int smoothedRtt() const;
+    int rttVariation() const;
+    // текущий таймаут ожидания отклика, мс
+    int responseTimeout() const;
 
     void setAttemptsCount(const int attempts);
+    void setBaudRate(const int baudRate);
+    // собственный порт Linux (termios + общий поток epoll) вместо QSerialPort;
+    // действует со следующего открытия, на других системах игнорируется
+    void setNativeSerialBackend(const bool enabled);
+    void setResponseTimeoutBounds(const int minTimeout, const int maxTimeout);
+    // допуск на задержку доставки данных драйвером порта
+    void setReadLatencyAllowance(const int msec);
+    void setCommandPriority(const int commandType, const int priority);
+    void setPriorityAgingInterval(const int msec);
+    // срок, после которого не отправленная команда типа снимается с очереди (0 - бессрочно)
+    void setCommandLifetime(const int commandType, const int msec);
+    // ограничения очереди команд (0 - без ограничения) и политика при переполнении
+    void setQueueLimits(const int maxCommands, const int maxBytes);
+    void setQueueOverflowPolicy(const int policy);
+    int queuedCommands() const;
+    int queuedBytes() const;
+    // заполнение пула команд и число обращений пула к общей куче
+    const Usk1OutgoingCommandPool &commandPool() const;
+    // не отправлять команды, запрашивающие уже подтверждённое состояние выхода/реле
+    void setSuppressRedundantCommands(const bool suppress);
+    // после стольких таймаутов подряд УСК считается недоступным (0 - никогда)
+    void setCircuitBreakerThreshold(const int failures);
+    bool isCircuitOpen() const;
+    // сколько после подтверждённого сброса ждать сообщения о перезапуске УСК, мс (0 - не ждать)
+    void setResetConfirmationTimeout(const int msec);
+    bool isWaitingForReset() const;
+    // пауза между командами при ошибках приёма УСК: начальная, предельная
+    // и уменьшение за каждый чистый отклик, мс
+    void setTransmitPacing(const int initialGap, const int maxGap, const int decreaseStep);
+    // текущая минимальная пауза между командами, мс
+    int transmitGap() const;
     bool openUsk();
     void closeUsk();
     void sendTime(const QDateTime &time);
@@ -38,6 +88,7 @@ public:
     void resetUsk();
     void changeRelayStatus(const int &rayNum, const int &kpuNum, const int &sensorNum, const int &relayStatus, const QString &sensorName);
     void changeVoltageStatus(const int numOutput, const bool &on);
+    void registerIncomingCommand(const int priority, Usk1IncomingCommand *command);
 
     void onUnknowCommand(const QString &command);
     void onError(int errorCode);
@@ -54,6 +105,9 @@ signals:
     void unknowCommand(const QString &uskName, const QString &command);
     void errorOnSendingCommand(const QString &uskName, const QString &commandDescription);
     void commandAccepted(const QString &uskName, const QString &commandDescription);
+    void commandDiscarded(const QString &uskName, const QString &commandDescription, const int &reason);
+    // очередь близка к переполнению (true) или снова разгружена (false)
+    void queueCongested(const QString &uskName, const bool &congested);
     void uskInfoPacketReceived(const QString &uskName, const int &infoPacket);
     void portIsOpen(const QString &uskName, const QString &portName);
     void portIsClose(const QString &uskName, const QString &portName);
@@ -67,32 +121,106 @@ signals:
     void sensorChanged(const QString &uskName, const int &rayNum, const int &kpuNum, const int &sensorNum, const int &state);
 
 private:
-    void parseIncomingData();
+    // frameComplete - после паузы t3.5: недопринятый пакет уже не будет дополнен
+    void parseIncomingData(const bool frameComplete = false);
+    bool isPacketInSync(const Usk1IncomingPacket &packet) const;
+    bool isPacketPrefixInSync() const;
+    bool isCorrectResponse(const char *response) const;
+    bool isResponseToCurrentCommand() const;
+    void onResponseReceived();
+    void startResetWait();
+    void finishResetWait(const bool confirmed);
+    void reportResync();
     void emitUskIsPresent(const bool isPresent);
-
-
-private slots:
-    void onReadyRead();
+    void enqueueCommand(const Usk1OutgoingCommandSharedPtr &command);
+    bool isRedundantCommand(const Usk1OutgoingCommandSharedPtr &command) const;
+    void updateQueueCongestion(const bool overflow);
+    qint64 characterTimeNs() const;
+    qint64 interCharacterTimeoutNs() const;
+    qint64 interFrameTimeoutNs() const;
+    void startFrameTimer();
+    void dropIncompleteFrame(const qint64 silenceNs);
+    void sendCurrentCommand();
+    void openCircuit();
+    void closeCircuit();
+    void scheduleProbe();
+    void onReceiveErrorReported();
+    const Usk1IncomingCommandFactory &incomingCommandFactory() const;
     void onTimerTimeout();
+    void onFrameTimerTimeout();
     void checkOutgoingBuffer();
     void onSendTimeTimeout();
+    QIODevice *createSerialPort();
+    bool configureSerialPort();
+    bool isActuatorTrafficPending() const;
+    void onProbeTimerTimeout();
+    void wheelTimerEvent(Usk1WheelTimer *timer);
+
+private slots:
+    void onReadyRead();
+    void onBytesWritten();
+    void onSerialPortError(QSerialPort::SerialPortError serialPortError);
 
 private:
-    QSerialPort *m_serialPort;
+    QIODevice *m_serialPort;
     bool m_firstUse;
     bool m_uskIsPresent;
     QString m_portName;
     QString m_uskName;
-    QByteArray m_buffer;
-    QTimer *m_timer;
-    QTimer *m_timerForCheckOutgoingPackets;
-    QTimer *m_timerForSendTime;
-    Usk1OutgoingCommandSharedPtrList m_outgoingCommnads;
+    Usk1RingBuffer m_buffer;
+    // все таймеры - на общем колесе рабочего потока
+    Usk1WheelTimer m_timer;
+    Usk1WheelTimer m_frameTimer;
+    Usk1WheelTimer m_timerForSendTime;
+    Usk1WheelTimer m_probeTimer;
+    Usk1WheelTimer m_paceTimer;
+    // объявлен раньше очереди и текущей команды - разрушается после них
+    Usk1OutgoingCommandPool m_commandPool;
+    // кадры команд НЧ выходов этого УСК, команды копируют их при создании
+    Usk1VoltageFrames m_voltageFrames;
+    Usk1OutgoingQueue m_outgoingQueue;
     Usk1OutgoingCommandSharedPtr m_currentCommand;
     States m_currentUskState;
+    // своя фабрика поверх общей, только если регистрировались свои команды
     Usk1IncomingCommandFactory *m_incomingCommandFactory;
     int m_attempts;
     int m_uskNum;
+    int m_baudRate;
+    bool m_nativeSerialBackend;
+    qint64 m_readLatencyAllowanceNs;
+    QElapsedTimer m_clock;
+    qint64 m_lastReadTimeNs;
+    int m_resyncDiscardedBytes;
+    Usk1LinkStatistics m_statistics;
+    bool m_suppressRedundantCommands;
+    // последнее подтверждённое (откликом) или сообщённое УСК состояние по ключу цели
+    QHash<quint64, int> m_confirmedStates;
+    Usk1RttEstimator m_rttEstimator;
+    // моменты отправки текущей команды и окончания её записи в порт (0 - ещё не записана)
+    qint64 m_sendTimeNs;
+    qint64 m_writeCompleteNs;
+    // по повторно отправленной команде время отклика не замеряется (алгоритм Карна)
+    bool m_retransmitted;
+    // предохранитель канала: пока разомкнут, команды отклоняются сразу,
+    // а наличие УСК проверяется редкими пробами
+    int m_circuitBreakerThreshold;
+    int m_consecutiveFailures;
+    bool m_circuitOpen;
+    int m_probeInterval;
+    bool m_queueCongested;
+    int m_resetConfirmationTimeout;
+    // момент подтверждения сброса - от него отсчитывается время восстановления
+    qint64 m_resetStartNs;
+    Usk1TransmitPacer m_pacer;
+    // окончание предыдущего обмена (отклик или отказ) - от него отсчитывается пауза
+    qint64 m_lastExchangeEndNs;
+    // паузу увеличиваем не чаще раза на отправленный пакет:
+    // УСК может сообщить об ошибке приёма одного пакета несколько раз
+    bool m_receiveErrorHandled;
+    // последнее подтверждение часов УСК (отклик на время или сообщение об установке), -1 - не было
+    qint64 m_clockConfirmedNs;
+    // сколько периодических синхронизаций подряд уступили исполнительным командам
+    int m_busyTimeSyncSkips;
 };
 
 #endif // SENDUSK1PROTOCOL_H
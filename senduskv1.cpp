@@ -1,125 +1,336 @@
 #include "senduskv1.h"
 #include "senduskv1workingthread.h"
+#include "usk1eventpipeline.h"
+#include "usk1outgoingqueue.h"
 #include <QThread>
 #include <QDebug>
 
 
+// больше потоков, чем УСК на одной машине бывает разумно обслуживать, не создаём
+#define maxWorkerThreads 16
+
+int SendUSKv1::m_workerThreadCount = 0;
+bool SendUSKv1::m_workerCpuAffinity = false;
+bool SendUSKv1::m_nativeSerialBackend = false;
+bool SendUSKv1::m_stagedEventDelivery = false;
+
 SendUSKv1::SendUSKv1(QObject *parent) :
-    QObject(parent)
+    QObject(parent),
+    m_pipelineThread(nullptr)
+{
+    m_pipeline = new Usk1EventPipeline(m_stagedEventDelivery);
+    connectPipeline(m_pipeline);
+    if (m_pipeline->isStaged()) {
+        m_pipelineThread = new QThread();
+        m_pipelineThread->setObjectName("SendUSKv1 delivery");
+        m_pipeline->moveToThread(m_pipelineThread);
+        m_pipelineThread->start();
+    }
+    int count = m_workerThreadCount > 0 ? m_workerThreadCount : QThread::idealThreadCount();
+    count = qBound(1, count, maxWorkerThreads);
+    for (int i = 0; i < count; ++i) {
+        SendUSKv1WorkingThread *worker = new SendUSKv1WorkingThread();
+        worker->setNativeSerialBackend(m_nativeSerialBackend);
+        worker->setEventPipeline(m_pipeline);
+        QThread *thread = new QThread();
+        thread->setObjectName(QString("SendUSKv1 worker %0").arg(i));
+        worker->moveToThread(thread);
+        thread->start();
+        if (m_workerCpuAffinity) {
+            QMetaObject::invokeMethod(worker, "bindToCpu", Qt::QueuedConnection,
+                                      Q_ARG(int, i % qMax(1, QThread::idealThreadCount())));
+        }
+        m_workers.append(worker);
+        m_threads.append(thread);
+        m_workerLoad.append(0);
+    }
+}
+
+SendUSKv1::~SendUSKv1()
 {
-    m_uskWorkingThread = new SendUSKv1WorkingThread();
-    m_thread = new QThread();
-    m_uskWorkingThread->moveToThread(m_thread);
-    connect(m_uskWorkingThread, SIGNAL(commandAccepted(QString,QString)),
+    for (SendUSKv1WorkingThread *worker : m_workers) {
+        QMetaObject::invokeMethod(worker, "removeAllUsk", Qt::BlockingQueuedConnection);
+        QMetaObject::invokeMethod(worker, "deleteLater", Qt::BlockingQueuedConnection);
+    }
+    for (QThread *thread : m_threads) {
+        thread->quit();
+    }
+    for (QThread *thread : m_threads) {
+        if (!thread->wait(20000))
+            thread->terminate();
+        delete thread;
+    }
+    // рабочие потоки остановлены - в очереди стадии доставки больше никто не пишет
+    if (m_pipelineThread) {
+        QMetaObject::invokeMethod(m_pipeline, "deleteLater", Qt::BlockingQueuedConnection);
+        m_pipelineThread->quit();
+        if (!m_pipelineThread->wait(20000))
+            m_pipelineThread->terminate();
+        delete m_pipelineThread;
+    } else {
+        delete m_pipeline;
+    }
+}
+
+void SendUSKv1::connectPipeline(Usk1EventPipeline *pipeline)
+{
+    connect(pipeline, SIGNAL(commandAccepted(QString,QString)),
             this, SIGNAL(commandAccepted(QString,QString)));
-    connect(m_uskWorkingThread, SIGNAL(detectedDisconnetcedKpu(QString,int,int)),
+    connect(pipeline, SIGNAL(commandDiscarded(QString,QString,int)),
+            this, SIGNAL(commandDiscarded(QString,QString,int)), Qt::QueuedConnection);
+    connect(pipeline, SIGNAL(queueCongested(QString,bool)),
+            this, SIGNAL(queueCongested(QString,bool)), Qt::QueuedConnection);
+    connect(pipeline, SIGNAL(detectedDisconnetcedKpu(QString,int,int)),
             this, SIGNAL(detectedDisconnetcedKpu(QString,int,int)), Qt::QueuedConnection);
-    connect(m_uskWorkingThread, SIGNAL(detectedNewKpu(QString,int,int)),
+    connect(pipeline, SIGNAL(detectedNewKpu(QString,int,int)),
             this, SIGNAL(detectedNewKpu(QString,int,int)), Qt::QueuedConnection);
-    connect(m_uskWorkingThread, SIGNAL(error(QString,int)),
+    connect(pipeline, SIGNAL(error(QString,int)),
             this, SIGNAL(error(QString,int)), Qt::QueuedConnection);
-    connect(m_uskWorkingThread, SIGNAL(errorOnSendingCommand(QString,QString)),
+    connect(pipeline, SIGNAL(errorOnSendingCommand(QString,QString)),
             this, SIGNAL(errorOnSendingCommand(QString,QString)), Qt::QueuedConnection);
-    connect(m_uskWorkingThread, SIGNAL(portIsClose(QString,QString)),
+    connect(pipeline, SIGNAL(portIsClose(QString,QString)),
             this, SIGNAL(portIsClose(QString,QString)), Qt::QueuedConnection);
-    connect(m_uskWorkingThread, SIGNAL(portIsOpen(QString,QString)),
+    connect(pipeline, SIGNAL(portIsOpen(QString,QString)),
             this, SIGNAL(portIsOpen(QString,QString)), Qt::QueuedConnection);
-    connect(m_uskWorkingThread, SIGNAL(sensorChanged(QString,int,int,int,int)),
+    connect(pipeline, SIGNAL(sensorChanged(QString,int,int,int,int)),
             this, SIGNAL(sensorChanged(QString,int,int,int,int)), Qt::QueuedConnection);
-    connect(m_uskWorkingThread, SIGNAL(startSendingCommand(QString,QString)),
+    connect(pipeline, SIGNAL(startSendingCommand(QString,QString)),
             this, SIGNAL(startSendingCommand(QString,QString)), Qt::QueuedConnection);
-    connect(m_uskWorkingThread, SIGNAL(unknowCommand(QString,QString)),
+    connect(pipeline, SIGNAL(unknowCommand(QString,QString)),
             this, SIGNAL(unknowCommand(QString,QString)), Qt::QueuedConnection);
-    connect(m_uskWorkingThread, SIGNAL(uskInfoPacketReceived(QString,int)),
+    connect(pipeline, SIGNAL(uskInfoPacketReceived(QString,int)),
             this, SIGNAL(uskInfoPacketReceived(QString,int)), Qt::QueuedConnection);
-    connect(m_uskWorkingThread, SIGNAL(uskIsPresent(QString,bool, bool)),
+    connect(pipeline, SIGNAL(uskIsPresent(QString,bool, bool)),
             this, SIGNAL(uskIsPresent(QString,bool,bool)), Qt::QueuedConnection);
-    connect(m_uskWorkingThread, SIGNAL(uskReset(QString)),
+    connect(pipeline, SIGNAL(uskReset(QString)),
             this, SIGNAL(uskReset(QString)), Qt::QueuedConnection);
-    connect(m_uskWorkingThread, SIGNAL(uskIsAdded(QString,bool)),
+    connect(pipeline, SIGNAL(uskIsAdded(QString,bool)),
             this, SIGNAL(uskIsAdded(QString,bool)), Qt::QueuedConnection);
-    connect(m_uskWorkingThread, SIGNAL(uskIsDeleted(QString,bool)),
+    connect(pipeline, SIGNAL(uskIsDeleted(QString,bool)),
             this, SIGNAL(uskIsDeleted(QString,bool)), Qt::QueuedConnection);
-    connect(m_uskWorkingThread, SIGNAL(voltageStatusChanged(QString,int,bool)),
+    connect(pipeline, SIGNAL(voltageStatusChanged(QString,int,bool)),
             this, SIGNAL(voltageStatusChanged(QString,int,bool)), Qt::QueuedConnection);
-    connect(m_uskWorkingThread, SIGNAL(receivedTextMessage(QString,QString)),
+    connect(pipeline, SIGNAL(receivedTextMessage(QString,QString)),
             this, SIGNAL(receivedTextMessage(QString,QString)));
-    m_thread->start();
 }
 
-SendUSKv1::~SendUSKv1()
+void SendUSKv1::getInfoAboutUsk(QStringList &uskNameList, QStringList &portNameList, QList<int> &uskStatusList)
 {
-    QMetaObject::invokeMethod(m_uskWorkingThread, "removeAllUsk", Qt::BlockingQueuedConnection);
-    QMetaObject::invokeMethod(m_uskWorkingThread, "deleteLater", Qt::BlockingQueuedConnection);
-    m_thread->quit();
-    if (!m_thread->wait(20000))
-        m_thread->terminate();
-    delete m_thread;
+    // не очень потокобезопасно
+    for (SendUSKv1WorkingThread *worker : m_workers) {
+        worker->getInfoAboutUsk(uskNameList, portNameList, uskStatusList);
+    }
 }
 
-void SendUSKv1::getInfoAboutUsk(QStringList &uskNameList, QStringList &portNameList, QList<int> &uskStatusList)
+void SendUSKv1::setWorkerThreadCount(const int count)
+{
+    m_workerThreadCount = qMax(0, count);
+}
+
+void SendUSKv1::setWorkerCpuAffinity(const bool enabled)
+{
+    m_workerCpuAffinity = enabled;
+}
+
+void SendUSKv1::setNativeSerialBackend(const bool enabled)
+{
+    m_nativeSerialBackend = enabled;
+}
+
+void SendUSKv1::setStagedEventDelivery(const bool enabled)
+{
+    m_stagedEventDelivery = enabled;
+}
+
+Usk1PipelineStatistics SendUSKv1::eventPipelineStatistics() const
+{
+    // не очень потокобезопасно
+    return m_pipeline->statistics();
+}
+
+int SendUSKv1::workerThreadCount() const
+{
+    return m_workers.size();
+}
+
+SendUSKv1WorkingThread *SendUSKv1::workerForUsk(const QString &uskName) const
+{
+    return m_workers.at(m_uskWorkers.value(uskName, 0));
+}
+
+int SendUSKv1::leastLoadedWorker() const
+{
+    int retVal = 0;
+    for (int i = 1; i < m_workerLoad.size(); ++i) {
+        if (m_workerLoad.at(i) < m_workerLoad.at(retVal)) {
+            retVal = i;
+        }
+    }
+    return retVal;
+}
+
+void SendUSKv1::setGlobalQueueLimits(const int maxCommands, const int maxBytes)
+{
+    Usk1OutgoingQueue::setGlobalLimits(maxCommands, maxBytes);
+}
+
+bool SendUSKv1::getUskResponseTiming(const QString &uskName, int &smoothedRtt, int &responseTimeout)
+{
+    // не очень потокобезопасно
+    return workerForUsk(uskName)->getUskResponseTiming(uskName, smoothedRtt, responseTimeout);
+}
+
+void SendUSKv1::setResponseTimeoutBounds(const QString &uskName, const int minTimeout, const int maxTimeout)
+{
+    QMetaObject::invokeMethod(workerForUsk(uskName), "setResponseTimeoutBounds", Qt::QueuedConnection,
+                              Q_ARG(QString, uskName), Q_ARG(int, minTimeout), Q_ARG(int, maxTimeout));
+}
+
+void SendUSKv1::setBaudRate(const QString &uskName, const int baudRate)
+{
+    QMetaObject::invokeMethod(workerForUsk(uskName), "setBaudRate", Qt::QueuedConnection,
+                              Q_ARG(QString, uskName), Q_ARG(int, baudRate));
+}
+
+void SendUSKv1::setReadLatencyAllowance(const QString &uskName, const int msec)
+{
+    QMetaObject::invokeMethod(workerForUsk(uskName), "setReadLatencyAllowance", Qt::QueuedConnection,
+                              Q_ARG(QString, uskName), Q_ARG(int, msec));
+}
+
+void SendUSKv1::setCommandPriority(const QString &uskName, const int commandType, const int priority)
+{
+    QMetaObject::invokeMethod(workerForUsk(uskName), "setCommandPriority", Qt::QueuedConnection,
+                              Q_ARG(QString, uskName), Q_ARG(int, commandType), Q_ARG(int, priority));
+}
+
+void SendUSKv1::setPriorityAgingInterval(const QString &uskName, const int msec)
+{
+    QMetaObject::invokeMethod(workerForUsk(uskName), "setPriorityAgingInterval", Qt::QueuedConnection,
+                              Q_ARG(QString, uskName), Q_ARG(int, msec));
+}
+
+void SendUSKv1::setSuppressRedundantCommands(const QString &uskName, const bool suppress)
+{
+    QMetaObject::invokeMethod(workerForUsk(uskName), "setSuppressRedundantCommands", Qt::QueuedConnection,
+                              Q_ARG(QString, uskName), Q_ARG(bool, suppress));
+}
+
+void SendUSKv1::setCircuitBreakerThreshold(const QString &uskName, const int failures)
+{
+    QMetaObject::invokeMethod(workerForUsk(uskName), "setCircuitBreakerThreshold", Qt::QueuedConnection,
+                              Q_ARG(QString, uskName), Q_ARG(int, failures));
+}
+
+void SendUSKv1::setQueueLimits(const QString &uskName, const int maxCommands, const int maxBytes)
+{
+    QMetaObject::invokeMethod(workerForUsk(uskName), "setQueueLimits", Qt::QueuedConnection,
+                              Q_ARG(QString, uskName), Q_ARG(int, maxCommands), Q_ARG(int, maxBytes));
+}
+
+void SendUSKv1::setQueueOverflowPolicy(const QString &uskName, const int policy)
+{
+    QMetaObject::invokeMethod(workerForUsk(uskName), "setQueueOverflowPolicy", Qt::QueuedConnection,
+                              Q_ARG(QString, uskName), Q_ARG(int, policy));
+}
+
+void SendUSKv1::setResetConfirmationTimeout(const QString &uskName, const int msec)
+{
+    QMetaObject::invokeMethod(workerForUsk(uskName), "setResetConfirmationTimeout", Qt::QueuedConnection,
+                              Q_ARG(QString, uskName), Q_ARG(int, msec));
+}
+
+void SendUSKv1::setTransmitPacing(const QString &uskName, const int initialGap, const int maxGap, const int decreaseStep)
+{
+    QMetaObject::invokeMethod(workerForUsk(uskName), "setTransmitPacing", Qt::QueuedConnection,
+                              Q_ARG(QString, uskName), Q_ARG(int, initialGap), Q_ARG(int, maxGap), Q_ARG(int, decreaseStep));
+}
+
+bool SendUSKv1::getUskQueueWait(const QString &uskName, const int priority, Usk1QueueWaitStatistics &statistics)
+{
+    // не очень потокобезопасно
+    return workerForUsk(uskName)->getUskQueueWait(uskName, priority, statistics);
+}
+
+bool SendUSKv1::getUskQueueDepth(const QString &uskName, int &commands, int &bytes,
+                                 int &highWaterCommands, int &highWaterBytes)
 {
     // не очень потокобезопасно
-    m_uskWorkingThread->getInfoAboutUsk(uskNameList, portNameList, uskStatusList);
+    return workerForUsk(uskName)->getUskQueueDepth(uskName, commands, bytes, highWaterCommands, highWaterBytes);
 }
 
 void SendUSKv1::addUsk(const QString &uskName, const QString &portName, int uskNum)
 {
     qDebug() << "add usk" << uskName;
-    QMetaObject::invokeMethod(m_uskWorkingThread, "addUsk", Qt::QueuedConnection,
+    // новый УСК - в наименее загруженный поток; повторное добавление уходит туда же,
+    // где УСК уже есть, и там отклоняется
+    if (!m_uskWorkers.contains(uskName)) {
+        const int worker = leastLoadedWorker();
+        m_uskWorkers.insert(uskName, worker);
+        ++m_workerLoad[worker];
+    }
+    QMetaObject::invokeMethod(workerForUsk(uskName), "addUsk", Qt::QueuedConnection,
                               Q_ARG(QString, uskName), Q_ARG(QString, portName), Q_ARG(int, uskNum));
 }
 
 void SendUSKv1::removeUsk(const QString &uskName)
 {
-    QMetaObject::invokeMethod(m_uskWorkingThread, "removeUsk", Qt::QueuedConnection,
+    SendUSKv1WorkingThread *worker = workerForUsk(uskName);
+    if (m_uskWorkers.contains(uskName)) {
+        --m_workerLoad[m_uskWorkers.take(uskName)];
+    }
+    QMetaObject::invokeMethod(worker, "removeUsk", Qt::QueuedConnection,
                               Q_ARG(QString, uskName));
 }
 
 void SendUSKv1::removeAllUsk()
 {
-    QMetaObject::invokeMethod(m_uskWorkingThread, "removeAllUsk", Qt::QueuedConnection);
+    m_uskWorkers.clear();
+    m_workerLoad.fill(0);
+    for (SendUSKv1WorkingThread *worker : m_workers) {
+        QMetaObject::invokeMethod(worker, "removeAllUsk", Qt::QueuedConnection);
+    }
 }
 
 void SendUSKv1::openUsk(const QString &uskName)
 {
-    QMetaObject::invokeMethod(m_uskWorkingThread, "openUsk", Qt::QueuedConnection,
+    QMetaObject::invokeMethod(workerForUsk(uskName), "openUsk", Qt::QueuedConnection,
                               Q_ARG(QString, uskName));
 }
 
 void SendUSKv1::closeUsk(const QString &uskName)
 {
-    QMetaObject::invokeMethod(m_uskWorkingThread, "closeUsk", Qt::QueuedConnection,
+    QMetaObject::invokeMethod(workerForUsk(uskName), "closeUsk", Qt::QueuedConnection,
                               Q_ARG(QString, uskName));
 }
 
 void SendUSKv1::sendTime(const QString &uskName, const QDateTime &time)
 {
-    QMetaObject::invokeMethod(m_uskWorkingThread, "sendTime", Qt::QueuedConnection,
+    QMetaObject::invokeMethod(workerForUsk(uskName), "sendTime", Qt::QueuedConnection,
                               Q_ARG(QString, uskName), Q_ARG(QDateTime, time));
 }
 
 void SendUSKv1::sendMessage(const QString &uskName, const QString &message)
 {
-    QMetaObject::invokeMethod(m_uskWorkingThread, "sendMessage", Qt::QueuedConnection,
+    QMetaObject::invokeMethod(workerForUsk(uskName), "sendMessage", Qt::QueuedConnection,
                               Q_ARG(QString, uskName), Q_ARG(QString, message));
 }
 
 void SendUSKv1::resetUsk(const QString &uskName)
 {
-    QMetaObject::invokeMethod(m_uskWorkingThread, "resetUsk", Qt::QueuedConnection,
+    QMetaObject::invokeMethod(workerForUsk(uskName), "resetUsk", Qt::QueuedConnection,
                               Q_ARG(QString, uskName));
 }
 
 void SendUSKv1::changeRelayStatus(const QString &uskName, const int &rayNum, const int &kpuNum, const int &sensorNum, const int &relayStatus, const QString &sensorName)
 {
-    QMetaObject::invokeMethod(m_uskWorkingThread, "changeRelayStatus", Qt::QueuedConnection,
+    QMetaObject::invokeMethod(workerForUsk(uskName), "changeRelayStatus", Qt::QueuedConnection,
                               Q_ARG(QString, uskName), Q_ARG(int, rayNum), Q_ARG(int, kpuNum),
                               Q_ARG(int, sensorNum), Q_ARG(int, relayStatus), Q_ARG(QString, sensorName));
 }
 
 void SendUSKv1::changeVoltageStatus(const QString &uskName, const int numOutput, const bool &on)
 {
-    QMetaObject::invokeMethod(m_uskWorkingThread, "changeVoltageStatus", Qt::QueuedConnection,
+    QMetaObject::invokeMethod(workerForUsk(uskName), "changeVoltageStatus", Qt::QueuedConnection,
                               Q_ARG(QString, uskName), Q_ARG(int, numOutput), Q_ARG(bool, on));
 }
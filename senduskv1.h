@@ -4,9 +4,13 @@
 #include <QObject>
 #include <QDateTime>
 #include <QList>
+#include <QHash>
+#include <QVector>
 #include "senduskv1global.h"
+#include "usk1statistics.h"
 
 class SendUSKv1WorkingThread;
+class Usk1EventPipeline;
 
 QT_BEGIN_NAMESPACE
 class QThread;
@@ -19,6 +23,58 @@ public:
     explicit SendUSKv1(QObject *parent = 0);
     ~SendUSKv1();
     void getInfoAboutUsk(QStringList &uskNameList, QStringList &portNameList, QList<int> &uskStatusList);
+    // сглаженное время отклика (-1 - ещё не измерено) и текущий таймаут ожидания отклика, мс
+    bool getUskResponseTiming(const QString &uskName, int &smoothedRtt, int &responseTimeout);
+    // настройки ниже - для добавленного УСК, применяются в его рабочем потоке по порядку вызовов.
+    // Пределы таймаута ожидания отклика, вычисляемого по времени отклика, мс
+    // (по умолчанию 100-3000); неверные пределы (min <= 0 или max < min) не меняют текущих
+    void setResponseTimeoutBounds(const QString &uskName, const int minTimeout, const int maxTimeout);
+    // скорость порта (по умолчанию 9600); по ней же отсчитываются паузы t1.5/t3.5
+    // между пакетами, поэтому открытый порт перенастраивается сразу
+    void setBaudRate(const QString &uskName, const int baudRate);
+    // допуск на задержку доставки данных драйвером порта, мс
+    void setReadLatencyAllowance(const QString &uskName, const int msec);
+    // класс приоритета (SendUSKv1Namespace::uskCommandPriorities) для типа команд
+    // (uskCommandTypes) и интервал, за который ожидающая команда поднимается на класс
+    void setCommandPriority(const QString &uskName, const int commandType, const int priority);
+    void setPriorityAgingInterval(const QString &uskName, const int msec);
+    // не отправлять команды реле/НЧ выхода, запрашивающие уже подтверждённое
+    // состояние (по умолчанию выключено); такая команда сразу сообщается принятой
+    void setSuppressRedundantCommands(const QString &uskName, const bool suppress);
+    // после стольких таймаутов подряд УСК считается недоступным и команды
+    // отклоняются до его ответа (по умолчанию 3, 0 - никогда)
+    void setCircuitBreakerThreshold(const QString &uskName, const int failures);
+    // ограничение очереди команд УСК (0 - без ограничения) и что делать с командой,
+    // не помещающейся в очередь (SendUSKv1Namespace::uskQueueOverflowPolicies)
+    void setQueueLimits(const QString &uskName, const int maxCommands, const int maxBytes);
+    void setQueueOverflowPolicy(const QString &uskName, const int policy);
+    // сколько после подтверждённого сброса ждать сообщения о перезапуске УСК, мс
+    // (по умолчанию 10000, 0 - не ждать)
+    void setResetConfirmationTimeout(const QString &uskName, const int msec);
+    // пауза между командами при ошибках приёма УСК: начальная, предельная
+    // и уменьшение за каждый чистый отклик, мс (по умолчанию 30, 1000 и 2)
+    void setTransmitPacing(const QString &uskName, const int initialGap, const int maxGap, const int decreaseStep);
+    // время ожидания в очереди команд класса приоритета priority
+    bool getUskQueueWait(const QString &uskName, const int priority, Usk1QueueWaitStatistics &statistics);
+    // глубина очереди команд УСК сейчас и наибольшая с его добавления
+    bool getUskQueueDepth(const QString &uskName, int &commands, int &bytes,
+                          int &highWaterCommands, int &highWaterBytes);
+    // ограничение суммарной очереди команд всех УСК (0 - без ограничения)
+    static void setGlobalQueueLimits(const int maxCommands, const int maxBytes);
+    // число рабочих потоков для объектов, создаваемых после вызова (0 - по числу ядер);
+    // УСК распределяются по потокам при добавлении
+    static void setWorkerThreadCount(const int count);
+    // закрепление рабочих потоков за ядрами (только Linux) для объектов, создаваемых после вызова
+    static void setWorkerCpuAffinity(const bool enabled);
+    // порты через termios и общий поток epoll вместо QSerialPort (только Linux)
+    // для объектов, создаваемых после вызова
+    static void setNativeSerialBackend(const bool enabled);
+    // доставка событий в отдельном потоке через очереди без блокировок (true)
+    // или прямо из рабочих потоков (false, по умолчанию) для объектов, создаваемых после вызова
+    static void setStagedEventDelivery(const bool enabled);
+    // очереди и задержка стадии доставки событий
+    Usk1PipelineStatistics eventPipelineStatistics() const;
+    int workerThreadCount() const;
 
 public slots:
 
@@ -38,6 +94,8 @@ signals:
     void error(const QString &uskName, int errorCode);
     void unknowCommand(const QString &uskName, const QString &command);
     void commandAccepted(const QString &uskName, const QString &commandDescription);
+    void commandDiscarded(const QString &uskName, const QString &commandDescription, const int &reason);
+    void queueCongested(const QString &uskName, const bool &congested);
     void errorOnSendingCommand(const QString &uskName, const QString &commandDescription);
     void uskInfoPacketReceived(const QString &uskName, const int &infoPacket);
     void portIsOpen(const QString &uskName, const QString &portName);
@@ -54,8 +112,25 @@ signals:
     void receivedTextMessage(const QString &uskName, const QString &textMessage);
 
 private:
-    SendUSKv1WorkingThread *m_uskWorkingThread;
-    QThread *m_thread;
+    void connectPipeline(Usk1EventPipeline *pipeline);
+    // поток, в котором живёт УСК (для неизвестного - первый: он ответит, что УСК нет)
+    SendUSKv1WorkingThread *workerForUsk(const QString &uskName) const;
+    int leastLoadedWorker() const;
+
+private:
+    QVector<SendUSKv1WorkingThread *> m_workers;
+    QVector<QThread *> m_threads;
+    Usk1EventPipeline *m_pipeline;
+    // поток стадии доставки (nullptr - стадия слита с рабочими потоками)
+    QThread *m_pipelineThread;
+    // размещение УСК по потокам и число УСК в каждом потоке; меняется только в потоке владельца
+    QHash<QString, int> m_uskWorkers;
+    QVector<int> m_workerLoad;
+
+    static int m_workerThreadCount;
+    static bool m_workerCpuAffinity;
+    static bool m_nativeSerialBackend;
+    static bool m_stagedEventDelivery;
 };
 
 #endif // SENDUSKV1_H
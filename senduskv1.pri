@@ -9,12 +9,38 @@ HEADERS += \
     ../SendUSKv1/senduskv1.h \
     ../SendUSKv1/senduskv1global.h \
     ../SendUSKv1/senduskv1workingthread.h \
+    ../SendUSKv1/usk1eventpipeline.h \
     ../SendUSKv1/usk1incomingcommand.h \
-    ../SendUSKv1/usk1outgoingcommand.h
+    ../SendUSKv1/usk1outgoingcommand.h \
+    ../SendUSKv1/usk1outgoingcommandpool.h \
+    ../SendUSKv1/usk1outgoingqueue.h \
+    ../SendUSKv1/usk1ringbuffer.h \
+    ../SendUSKv1/usk1rttestimator.h \
+    ../SendUSKv1/usk1spscqueue.h \
+    ../SendUSKv1/usk1statistics.h \
+    ../SendUSKv1/usk1timerwheel.h \
+    ../SendUSKv1/usk1timesyncscheduler.h \
+    ../SendUSKv1/usk1transmitpacer.h \
+    ../SendUSKv1/usk1win1251.h
 
 SOURCES += \
     ../SendUSKv1/sendusk1protocol.cpp \
     ../SendUSKv1/senduskv1.cpp \
     ../SendUSKv1/senduskv1workingthread.cpp \
+    ../SendUSKv1/usk1eventpipeline.cpp \
     ../SendUSKv1/usk1incomingcommand.cpp \
-    ../SendUSKv1/usk1outgoingcommand.cpp
+    ../SendUSKv1/usk1outgoingcommand.cpp \
+    ../SendUSKv1/usk1outgoingcommandpool.cpp \
+    ../SendUSKv1/usk1outgoingqueue.cpp \
+    ../SendUSKv1/usk1ringbuffer.cpp \
+    ../SendUSKv1/usk1rttestimator.cpp \
+    ../SendUSKv1/usk1timerwheel.cpp \
+    ../SendUSKv1/usk1timesyncscheduler.cpp \
+    ../SendUSKv1/usk1transmitpacer.cpp \
+    ../SendUSKv1/usk1win1251.cpp
+
+# собственный последовательный порт (termios + epoll)
+linux {
+    HEADERS += ../SendUSKv1/usk1nativeserialport.h
+    SOURCES += ../SendUSKv1/usk1nativeserialport.cpp
+}
@@ -10,7 +10,11 @@ enum errorCodes
     errorTimeoutWhileWaitResponse,
     errorUskIsntResponse,
     errorUskInstPresent,
-    errorUskWrongPacket
+    errorUskWrongPacket,
+    errorUskPacketResync,
+    errorUskCircuitOpen,    // УСК не отвечает, команды отклоняются до восстановления связи
+    errorUskResetNotConfirmed,  // после сброса УСК не сообщил о перезапуске, отправка возобновлена по таймауту
+    errorPortFailure            // порт отказал (устройство отключено), порт закрыт
 };
 
 enum uskInfoPackets
@@ -21,6 +25,38 @@ enum uskInfoPackets
     packetUskErrorReceivingRS
 };
 
+enum uskCommandTypes {
+    commandSendTime,
+    commandSendMessage,
+    commandReset,
+    commandChangeRelay,
+    commandChangeVoltage,
+    commandTypesCount
+};
+
+// классы приоритета исходящих команд, значение передаётся в байте приоритета пакета
+enum uskCommandPriorities {
+    priorityLow,
+    priorityNormal,
+    priorityHigh,
+    prioritiesCount
+};
+
+// почему команда снята с очереди, не будучи отправленной
+enum uskCommandDiscardReasons {
+    discardCoalesced,       // заменена более новой командой для той же цели
+    discardUskUnavailable,  // УСК не отвечает (разомкнут предохранитель канала)
+    discardExpired,         // истёк срок, в течение которого команда имела смысл
+    discardQueueOverflow    // очередь переполнена (см. uskQueueOverflowPolicies)
+};
+
+// что делать с командой, не помещающейся в очередь
+enum uskQueueOverflowPolicies {
+    overflowRejectNew,          // отклонить новую команду
+    overflowDropOldest,         // вытеснить самую старую команду очереди
+    overflowDropLowestPriority  // вытеснить старейшую команду низшего класса, если он не выше нового
+};
+
 enum uskStates {
     uskIsPresent,
     uskIsMissing,
@@ -2,13 +2,23 @@
 #include "senduskv1global.h"
 
 #include "sendusk1protocol.h"
+#include "usk1eventpipeline.h"
 
 #include <QStringList>
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 using namespace SendUSKv1Namespace;
 
 SendUSKv1WorkingThread::SendUSKv1WorkingThread(QObject *parent) :
-    QObject(parent)
+    QObject(parent),
+    m_nativeSerialBackend(false),
+    m_pipeline(nullptr),
+    m_producer(-1)
 {
 
 }
@@ -26,6 +36,52 @@ void SendUSKv1WorkingThread::getInfoAboutUsk(QStringList &uskNameList, QStringLi
     }
 }
 
+bool SendUSKv1WorkingThread::getUskResponseTiming(const QString &uskName, int &smoothedRtt, int &responseTimeout)
+{
+    SendUsk1Protocol *protocol = m_hashOfUsk.value(uskName, nullptr);
+    if (!protocol) {
+        return false;
+    }
+    smoothedRtt = protocol->smoothedRtt();
+    responseTimeout = protocol->responseTimeout();
+    return true;
+}
+
+bool SendUSKv1WorkingThread::getUskQueueWait(const QString &uskName, const int priority, Usk1QueueWaitStatistics &statistics)
+{
+    SendUsk1Protocol *protocol = m_hashOfUsk.value(uskName, nullptr);
+    if (!protocol || priority < 0 || priority >= prioritiesCount) {
+        return false;
+    }
+    statistics = protocol->statistics().queueWait[priority];
+    return true;
+}
+
+bool SendUSKv1WorkingThread::getUskQueueDepth(const QString &uskName, int &commands, int &bytes,
+                                              int &highWaterCommands, int &highWaterBytes)
+{
+    SendUsk1Protocol *protocol = m_hashOfUsk.value(uskName, nullptr);
+    if (!protocol) {
+        return false;
+    }
+    commands = protocol->queuedCommands();
+    bytes = protocol->queuedBytes();
+    highWaterCommands = protocol->statistics().queueHighWaterCommands;
+    highWaterBytes = protocol->statistics().queueHighWaterBytes;
+    return true;
+}
+
+void SendUSKv1WorkingThread::setNativeSerialBackend(const bool enabled)
+{
+    m_nativeSerialBackend = enabled;
+}
+
+void SendUSKv1WorkingThread::setEventPipeline(Usk1EventPipeline *pipeline)
+{
+    m_pipeline = pipeline;
+    m_producer = pipeline ? pipeline->addProducer() : -1;
+}
+
 void SendUSKv1WorkingThread::addUsk(const QString &uskName, const QString &portName, int uskNum)
 {
     bool emitVal = false;
@@ -35,54 +91,61 @@ void SendUSKv1WorkingThread::addUsk(const QString &uskName, const QString &portN
         protocol->setUskNum(uskNum);
         protocol->setSerialPortName(portName);
         protocol->setAttemptsCount(3);
+        protocol->setNativeSerialBackend(m_nativeSerialBackend);
         m_hashOfUsk[uskName] = protocol;
         connect(protocol, SIGNAL(commandAccepted(QString,QString)),
-                this, SIGNAL(commandAccepted(QString,QString)));
+                this, SLOT(onCommandAccepted(QString,QString)));
+
+        connect(protocol, SIGNAL(commandDiscarded(QString,QString,int)),
+                this, SLOT(onCommandDiscarded(QString,QString,int)));
+
+        connect(protocol, SIGNAL(queueCongested(QString,bool)),
+                this, SLOT(onQueueCongested(QString,bool)));
 
         connect(protocol, SIGNAL(detectedDisconnetcedKpu(QString,int,int)),
-                this, SIGNAL(detectedDisconnetcedKpu(QString,int,int)));
+                this, SLOT(onDetectedDisconnetcedKpu(QString,int,int)));
 
         connect(protocol, SIGNAL(detectedNewKpu(QString,int,int)),
-                this, SIGNAL(detectedNewKpu(QString,int,int)));
+                this, SLOT(onDetectedNewKpu(QString,int,int)));
 
         connect(protocol, SIGNAL(error(QString,int)),
-                this, SIGNAL(error(QString,int)));
+                this, SLOT(onError(QString,int)));
 
         connect(protocol, SIGNAL(errorOnSendingCommand(QString,QString)),
-                this, SIGNAL(errorOnSendingCommand(QString,QString)));
+                this, SLOT(onErrorOnSendingCommand(QString,QString)));
 
         connect(protocol, SIGNAL(portIsClose(QString,QString)),
-                this, SIGNAL(portIsClose(QString,QString)));
+                this, SLOT(onPortIsClose(QString,QString)));
 
         connect(protocol, SIGNAL(portIsOpen(QString,QString)),
-                this, SIGNAL(portIsOpen(QString,QString)));
+                this, SLOT(onPortIsOpen(QString,QString)));
 
         connect(protocol, SIGNAL(receivedTextMessage(QString,QString)),
-                this, SIGNAL(receivedTextMessage(QString,QString)));
+                this, SLOT(onReceivedTextMessage(QString,QString)));
 
         connect(protocol, SIGNAL(sensorChanged(QString,int,int,int,int)),
-                this, SIGNAL(sensorChanged(QString,int,int,int,int)));
+                this, SLOT(onSensorChanged(QString,int,int,int,int)));
 
         connect(protocol, SIGNAL(startSendingCommand(QString,QString)),
-                this, SIGNAL(startSendingCommand(QString,QString)));
+                this, SLOT(onStartSendingCommand(QString,QString)));
 
         connect(protocol, SIGNAL(unknowCommand(QString,QString)),
-                this, SIGNAL(unknowCommand(QString,QString)));
+                this, SLOT(onUnknowCommand(QString,QString)));
 
         connect(protocol, SIGNAL(uskInfoPacketReceived(QString,int)),
-                this, SIGNAL(uskInfoPacketReceived(QString,int)));
+                this, SLOT(onUskInfoPacketReceived(QString,int)));
 
         connect(protocol, SIGNAL(uskIsPresent(QString,bool,bool)),
-                this, SIGNAL(uskIsPresent(QString,bool,bool)));
+                this, SLOT(onUskIsPresent(QString,bool,bool)));
 
         connect(protocol, SIGNAL(uskReset(QString)),
-                this, SIGNAL(uskReset(QString)));
+                this, SLOT(onUskReset(QString)));
 
         connect(protocol, SIGNAL(voltageStatusChanged(QString,int,bool)),
-                this, SIGNAL(voltageStatusChanged(QString,int,bool)));
+                this, SLOT(onVoltageStatusChanged(QString,int,bool)));
 
     }
-    emit uskIsAdded(uskName, emitVal);
+    post(Usk1Event::eventUskIsAdded, uskName, QString(), emitVal);
 }
 
 void SendUSKv1WorkingThread::removeUsk(const QString &uskName)
@@ -94,7 +157,7 @@ void SendUSKv1WorkingThread::removeUsk(const QString &uskName)
         m_hashOfUsk.remove(uskName);
         emitVal = true;
     }
-    emit uskIsDeleted(uskName, emitVal);
+    post(Usk1Event::eventUskIsDeleted, uskName, QString(), emitVal);
 }
 
 void SendUSKv1WorkingThread::openUsk(const QString &uskName)
@@ -160,3 +223,200 @@ void SendUSKv1WorkingThread::removeAllUsk()
         removeUsk(uskName);
     }
 }
+
+void SendUSKv1WorkingThread::setBaudRate(const QString &uskName, const int baudRate)
+{
+    SendUsk1Protocol *protocol = m_hashOfUsk.value(uskName, nullptr);
+    if (protocol) {
+        protocol->setBaudRate(baudRate);
+    }
+}
+
+void SendUSKv1WorkingThread::setReadLatencyAllowance(const QString &uskName, const int msec)
+{
+    SendUsk1Protocol *protocol = m_hashOfUsk.value(uskName, nullptr);
+    if (protocol) {
+        protocol->setReadLatencyAllowance(msec);
+    }
+}
+
+void SendUSKv1WorkingThread::setCommandPriority(const QString &uskName, const int commandType, const int priority)
+{
+    SendUsk1Protocol *protocol = m_hashOfUsk.value(uskName, nullptr);
+    if (protocol) {
+        protocol->setCommandPriority(commandType, priority);
+    }
+}
+
+void SendUSKv1WorkingThread::setPriorityAgingInterval(const QString &uskName, const int msec)
+{
+    SendUsk1Protocol *protocol = m_hashOfUsk.value(uskName, nullptr);
+    if (protocol) {
+        protocol->setPriorityAgingInterval(msec);
+    }
+}
+
+void SendUSKv1WorkingThread::setSuppressRedundantCommands(const QString &uskName, const bool suppress)
+{
+    SendUsk1Protocol *protocol = m_hashOfUsk.value(uskName, nullptr);
+    if (protocol) {
+        protocol->setSuppressRedundantCommands(suppress);
+    }
+}
+
+void SendUSKv1WorkingThread::setResponseTimeoutBounds(const QString &uskName, const int minTimeout, const int maxTimeout)
+{
+    SendUsk1Protocol *protocol = m_hashOfUsk.value(uskName, nullptr);
+    if (protocol) {
+        protocol->setResponseTimeoutBounds(minTimeout, maxTimeout);
+    }
+}
+
+void SendUSKv1WorkingThread::setCircuitBreakerThreshold(const QString &uskName, const int failures)
+{
+    SendUsk1Protocol *protocol = m_hashOfUsk.value(uskName, nullptr);
+    if (protocol) {
+        protocol->setCircuitBreakerThreshold(failures);
+    }
+}
+
+void SendUSKv1WorkingThread::setQueueLimits(const QString &uskName, const int maxCommands, const int maxBytes)
+{
+    SendUsk1Protocol *protocol = m_hashOfUsk.value(uskName, nullptr);
+    if (protocol) {
+        protocol->setQueueLimits(maxCommands, maxBytes);
+    }
+}
+
+void SendUSKv1WorkingThread::setQueueOverflowPolicy(const QString &uskName, const int policy)
+{
+    SendUsk1Protocol *protocol = m_hashOfUsk.value(uskName, nullptr);
+    if (protocol) {
+        protocol->setQueueOverflowPolicy(policy);
+    }
+}
+
+void SendUSKv1WorkingThread::setResetConfirmationTimeout(const QString &uskName, const int msec)
+{
+    SendUsk1Protocol *protocol = m_hashOfUsk.value(uskName, nullptr);
+    if (protocol) {
+        protocol->setResetConfirmationTimeout(msec);
+    }
+}
+
+void SendUSKv1WorkingThread::setTransmitPacing(const QString &uskName, const int initialGap, const int maxGap, const int decreaseStep)
+{
+    SendUsk1Protocol *protocol = m_hashOfUsk.value(uskName, nullptr);
+    if (protocol) {
+        protocol->setTransmitPacing(initialGap, maxGap, decreaseStep);
+    }
+}
+
+void SendUSKv1WorkingThread::bindToCpu(const int cpu)
+{
+#ifdef Q_OS_LINUX
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpu, &cpuSet);
+    const int res = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+    if (res != 0) {
+        qDebug() << Q_FUNC_INFO << "can't bind worker thread to cpu" << cpu << "error" << res;
+    }
+#else
+    Q_UNUSED(cpu)
+#endif
+}
+
+void SendUSKv1WorkingThread::post(const int kind, const QString &uskName, const QString &text,
+                                  const int arg0, const int arg1, const int arg2, const int arg3)
+{
+    if (m_pipeline) {
+        Usk1Event event(kind, uskName, text, arg0, arg1, arg2, arg3);
+        m_pipeline->post(m_producer, event);
+    }
+}
+
+void SendUSKv1WorkingThread::onError(const QString &uskName, int errorCode)
+{
+    post(Usk1Event::eventError, uskName, QString(), errorCode);
+}
+
+void SendUSKv1WorkingThread::onUnknowCommand(const QString &uskName, const QString &command)
+{
+    post(Usk1Event::eventUnknowCommand, uskName, command);
+}
+
+void SendUSKv1WorkingThread::onErrorOnSendingCommand(const QString &uskName, const QString &commandDescription)
+{
+    post(Usk1Event::eventErrorOnSendingCommand, uskName, commandDescription);
+}
+
+void SendUSKv1WorkingThread::onCommandAccepted(const QString &uskName, const QString &commandDescription)
+{
+    post(Usk1Event::eventCommandAccepted, uskName, commandDescription);
+}
+
+void SendUSKv1WorkingThread::onCommandDiscarded(const QString &uskName, const QString &commandDescription, const int &reason)
+{
+    post(Usk1Event::eventCommandDiscarded, uskName, commandDescription, reason);
+}
+
+void SendUSKv1WorkingThread::onQueueCongested(const QString &uskName, const bool &congested)
+{
+    post(Usk1Event::eventQueueCongested, uskName, QString(), congested);
+}
+
+void SendUSKv1WorkingThread::onUskInfoPacketReceived(const QString &uskName, const int &infoPacket)
+{
+    post(Usk1Event::eventUskInfoPacketReceived, uskName, QString(), infoPacket);
+}
+
+void SendUSKv1WorkingThread::onPortIsOpen(const QString &uskName, const QString &portName)
+{
+    post(Usk1Event::eventPortIsOpen, uskName, portName);
+}
+
+void SendUSKv1WorkingThread::onPortIsClose(const QString &uskName, const QString &portName)
+{
+    post(Usk1Event::eventPortIsClose, uskName, portName);
+}
+
+void SendUSKv1WorkingThread::onUskReset(const QString &uskName)
+{
+    post(Usk1Event::eventUskReset, uskName);
+}
+
+void SendUSKv1WorkingThread::onReceivedTextMessage(const QString &uskName, const QString &textMessage)
+{
+    post(Usk1Event::eventReceivedTextMessage, uskName, textMessage);
+}
+
+void SendUSKv1WorkingThread::onUskIsPresent(const QString &uskName, const bool &present, const bool &firstUse)
+{
+    post(Usk1Event::eventUskIsPresent, uskName, QString(), present, firstUse);
+}
+
+void SendUSKv1WorkingThread::onStartSendingCommand(const QString &uskName, const QString &commandDescription)
+{
+    post(Usk1Event::eventStartSendingCommand, uskName, commandDescription);
+}
+
+void SendUSKv1WorkingThread::onDetectedNewKpu(const QString &uskName, const int &rayNum, const int &kpuNum)
+{
+    post(Usk1Event::eventDetectedNewKpu, uskName, QString(), rayNum, kpuNum);
+}
+
+void SendUSKv1WorkingThread::onDetectedDisconnetcedKpu(const QString &uskName, const int &rayNum, const int &kpuNum)
+{
+    post(Usk1Event::eventDetectedDisconnetcedKpu, uskName, QString(), rayNum, kpuNum);
+}
+
+void SendUSKv1WorkingThread::onVoltageStatusChanged(const QString &uskName, const int &outputNumber, const bool &status)
+{
+    post(Usk1Event::eventVoltageStatusChanged, uskName, QString(), outputNumber, status);
+}
+
+void SendUSKv1WorkingThread::onSensorChanged(const QString &uskName, const int &rayNum, const int &kpuNum, const int &sensorNum, const int &state)
+{
+    post(Usk1Event::eventSensorChanged, uskName, QString(), rayNum, kpuNum, sensorNum, state);
+}
@@ -6,12 +6,23 @@
 #include <QHash>
 
 class SendUsk1Protocol;
+struct Usk1QueueWaitStatistics;
+class Usk1EventPipeline;
+
 class SendUSKv1WorkingThread : public QObject
 {
     Q_OBJECT
 public:
     explicit SendUSKv1WorkingThread(QObject *parent = 0);
     void getInfoAboutUsk(QStringList &uskNameList, QStringList &portNameList, QList<int> &uskStatusList);
+    bool getUskResponseTiming(const QString &uskName, int &smoothedRtt, int &responseTimeout);
+    bool getUskQueueWait(const QString &uskName, const int priority, Usk1QueueWaitStatistics &statistics);
+    bool getUskQueueDepth(const QString &uskName, int &commands, int &bytes,
+                          int &highWaterCommands, int &highWaterBytes);
+    // для УСК, добавляемых после вызова
+    void setNativeSerialBackend(const bool enabled);
+    // события всех УСК потока уходят в стадию доставки; до переноса в рабочий поток
+    void setEventPipeline(Usk1EventPipeline *pipeline);
 
 public slots:
     void addUsk(const QString &uskName, const QString &portName, int uskNum);
@@ -24,30 +35,49 @@ public slots:
     void changeRelayStatus(const QString &uskName, const int &rayNum, const int &kpuNum, const int &sensorNum, const int &relayStatus, const QString &sensorName);
     void changeVoltageStatus(const QString &uskName, const int numOutput, const bool &on);
     void removeAllUsk();
+    void setBaudRate(const QString &uskName, const int baudRate);
+    void setReadLatencyAllowance(const QString &uskName, const int msec);
+    void setCommandPriority(const QString &uskName, const int commandType, const int priority);
+    void setPriorityAgingInterval(const QString &uskName, const int msec);
+    void setSuppressRedundantCommands(const QString &uskName, const bool suppress);
+    void setResponseTimeoutBounds(const QString &uskName, const int minTimeout, const int maxTimeout);
+    void setCircuitBreakerThreshold(const QString &uskName, const int failures);
+    void setQueueLimits(const QString &uskName, const int maxCommands, const int maxBytes);
+    void setQueueOverflowPolicy(const QString &uskName, const int policy);
+    void setResetConfirmationTimeout(const QString &uskName, const int msec);
+    void setTransmitPacing(const QString &uskName, const int initialGap, const int maxGap, const int decreaseStep);
+    // закрепляет поток, в котором живёт объект, за ядром cpu (только Linux)
+    void bindToCpu(const int cpu);
+
+private slots:
+    void onError(const QString &uskName, int errorCode);
+    void onUnknowCommand(const QString &uskName, const QString &command);
+    void onErrorOnSendingCommand(const QString &uskName, const QString &commandDescription);
+    void onCommandAccepted(const QString &uskName, const QString &commandDescription);
+    void onCommandDiscarded(const QString &uskName, const QString &commandDescription, const int &reason);
+    void onQueueCongested(const QString &uskName, const bool &congested);
+    void onUskInfoPacketReceived(const QString &uskName, const int &infoPacket);
+    void onPortIsOpen(const QString &uskName, const QString &portName);
+    void onPortIsClose(const QString &uskName, const QString &portName);
+    void onUskReset(const QString &uskName);
+    void onReceivedTextMessage(const QString &uskName, const QString &textMessage);
+    void onUskIsPresent(const QString &uskName, const bool &present, const bool &firstUse);
+    void onStartSendingCommand(const QString &uskName, const QString &commandDescription);
+    void onDetectedNewKpu(const QString &uskName, const int &rayNum, const int &kpuNum);
+    void onDetectedDisconnetcedKpu(const QString &uskName, const int &rayNum, const int &kpuNum);
+    void onVoltageStatusChanged(const QString &uskName, const int &outputNumber, const bool &status);
+    void onSensorChanged(const QString &uskName, const int &rayNum, const int &kpuNum, const int &sensorNum, const int &state);
 
-signals:
-    void error(const QString &uskName, int errorCode);
-    void unknowCommand(const QString &uskName, const QString &command);
-    void errorOnSendingCommand(const QString &uskName, const QString &commandDescription);
-    void commandAccepted(const QString &uskName, const QString &commandDescription);
-    void uskInfoPacketReceived(const QString &uskName, const int &infoPacket);
-    void portIsOpen(const QString &uskName, const QString &portName);
-    void portIsClose(const QString &uskName, const QString &portName);
-    void uskReset(const QString &uskName);
-    void receivedTextMessage(const QString &uskName, const QString &textMessage);
-    void uskIsPresent(const QString &uskName, const bool &present, const bool &firstUse);
-    void startSendingCommand(const QString &uskName, const QString &commandDescription);
-    void detectedNewKpu(const QString &uskName, const int &rayNum, const int &kpuNum);
-    void detectedDisconnetcedKpu(const QString &uskName, const int &rayNum, const int &kpuNum);
-    void voltageStatusChanged(const QString &uskName, const int &outputNumber, const bool &status);
-    void sensorChanged(const QString &uskName, const int &rayNum, const int &kpuNum, const int &sensorNum, const int &state);
-    void uskIsAdded(const QString &uskName, const bool &added);
-    void uskIsDeleted(const QString &uksName, const bool &deleted);
-
-signals:
+private:
+    void post(const int kind, const QString &uskName, const QString &text = QString(),
+              const int arg0 = 0, const int arg1 = 0, const int arg2 = 0, const int arg3 = 0);
 
 private:
     QHash<QString, SendUsk1Protocol*> m_hashOfUsk;
+    bool m_nativeSerialBackend;
+    Usk1EventPipeline *m_pipeline;
+    // номер очереди потока в стадии доставки
+    int m_producer;
 
 };
 
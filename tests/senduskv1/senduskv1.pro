@@ -0,0 +1,5 @@
+TARGET = tst_senduskv1
+
+include(../tests.pri)
+
+SOURCES += tst_senduskv1.cpp
@@ -0,0 +1,166 @@
+#include <QtTest>
+#include <QSocketNotifier>
+#include "senduskv1.h"
+#include "usk1outgoingcommand.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+// проверки через открытый интерфейс SendUSKv1 (только Linux): вместо УСК -
+// имитатор на ведущей стороне псевдотерминала, порт библиотеки открывает ведомую
+namespace {
+
+// отклик УСК: первый байт не совпадает с номером УСК в тесте, контрольная сумма сходится
+const char ackPacket[] = {0x06, 0x00, 0x00, 0x00, 0x06};
+// УСК отвечает не раньше, чем примет кадр целиком (27 байт на 9600 - около 30 мс)
+const int ackDelay = 60;
+
+} // namespace
+
+class Usk1Simulator : public QObject
+{
+    Q_OBJECT
+public:
+    Usk1Simulator() :
+        m_masterFd(-1),
+        m_slaveFd(-1),
+        m_notifier(nullptr),
+        m_voltageFrames(0),
+        m_acknowledged(0)
+    {
+    }
+
+    ~Usk1Simulator()
+    {
+        delete m_notifier;
+        if (m_slaveFd >= 0) {
+            ::close(m_slaveFd);
+        }
+        if (m_masterFd >= 0) {
+            ::close(m_masterFd);
+        }
+    }
+
+    bool open()
+    {
+        m_masterFd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if (m_masterFd < 0 || grantpt(m_masterFd) != 0 || unlockpt(m_masterFd) != 0) {
+            return false;
+        }
+        m_portName = QString::fromLocal8Bit(ptsname(m_masterFd));
+        // своя копия ведомой стороны: без неё чтение ведущей отдаёт EIO, пока
+        // порт библиотеки закрыт; до настройки портом - без эха и обработки
+        m_slaveFd = ::open(ptsname(m_masterFd), O_RDWR | O_NOCTTY);
+        if (m_slaveFd < 0) {
+            return false;
+        }
+        termios tio;
+        tcgetattr(m_slaveFd, &tio);
+        cfmakeraw(&tio);
+        tcsetattr(m_slaveFd, TCSANOW, &tio);
+        m_notifier = new QSocketNotifier(m_masterFd, QSocketNotifier::Read);
+        connect(m_notifier, &QSocketNotifier::activated, this, &Usk1Simulator::onReadable);
+        return true;
+    }
+
+    QString portName() const
+    {
+        return m_portName;
+    }
+
+    int voltageFrames() const
+    {
+        return m_voltageFrames;
+    }
+
+    int acknowledged() const
+    {
+        return m_acknowledged;
+    }
+
+private slots:
+    void onReadable()
+    {
+        char data[256];
+        ssize_t res;
+        while ((res = ::read(m_masterFd, data, sizeof(data))) > 0) {
+            m_received.append(data, static_cast<int>(res));
+        }
+        while (m_received.size() >= Usk1OutgoingCommand::FrameSize) {
+            const QByteArray frame = m_received.left(Usk1OutgoingCommand::FrameSize);
+            m_received.remove(0, Usk1OutgoingCommand::FrameSize);
+            const quint32 flags = quint8(frame.at(3)) | quint8(frame.at(4)) << 8 |
+                    quint8(frame.at(5)) << 16 | quint32(quint8(frame.at(6))) << 24;
+            if (flags == 0x00000020 || flags == 0x00000100 || flags == 0x00002000 || flags == 0x00004000) {
+                ++m_voltageFrames;
+            }
+            QTimer::singleShot(ackDelay, this, SLOT(acknowledge()));
+        }
+    }
+
+    void acknowledge()
+    {
+        if (::write(m_masterFd, ackPacket, sizeof(ackPacket)) == sizeof(ackPacket)) {
+            ++m_acknowledged;
+        }
+    }
+
+private:
+    int m_masterFd;
+    int m_slaveFd;
+    QSocketNotifier *m_notifier;
+    QString m_portName;
+    QByteArray m_received;
+    int m_voltageFrames;
+    int m_acknowledged;
+};
+
+class SendUskV1Test : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void suppressRedundantCommands();
+};
+
+void SendUskV1Test::suppressRedundantCommands()
+{
+    Usk1Simulator usk;
+    QVERIFY(usk.open());
+    SendUSKv1 sendUsk;
+    QSignalSpy opened(&sendUsk, &SendUSKv1::portIsOpen);
+    QSignalSpy accepted(&sendUsk, &SendUSKv1::commandAccepted);
+    sendUsk.addUsk("usk", usk.portName(), 1);
+    sendUsk.setSuppressRedundantCommands("usk", true);
+    sendUsk.openUsk("usk");
+    QTRY_COMPARE(opened.count(), 1);
+    // синхронизация времени при открытии порта
+    QTRY_VERIFY(usk.acknowledged() >= 1);
+
+    sendUsk.changeVoltageStatus("usk", 1, true);
+    QTRY_COMPARE(accepted.count(), 1);
+    QCOMPARE(usk.voltageFrames(), 1);
+
+    // состояние подтверждено откликом - повтор принимается без передачи
+    sendUsk.changeVoltageStatus("usk", 1, true);
+    QTRY_COMPARE(accepted.count(), 2);
+    QTest::qWait(ackDelay * 3);
+    QCOMPARE(usk.voltageFrames(), 1);
+
+    // другое состояние передаётся
+    sendUsk.changeVoltageStatus("usk", 1, false);
+    QTRY_COMPARE(accepted.count(), 3);
+    QCOMPARE(usk.voltageFrames(), 2);
+
+    // без подавления повтор снова уходит в линию
+    sendUsk.setSuppressRedundantCommands("usk", false);
+    sendUsk.changeVoltageStatus("usk", 1, false);
+    QTRY_COMPARE(accepted.count(), 4);
+    QCOMPARE(usk.voltageFrames(), 3);
+}
+
+QTEST_GUILESS_MAIN(SendUskV1Test)
+
+#include "tst_senduskv1.moc"
@@ -0,0 +1,51 @@
+##################################################
+# общие настройки тестов: библиотека собирается из исходников в корне
+QT += core serialport testlib
+QT -= gui
+
+CONFIG += console testcase c++11
+CONFIG -= app_bundle
+
+INCLUDEPATH += $$PWD/..
+
+##################################################
+
+HEADERS += \
+    $$PWD/../sendusk1protocol.h \
+    $$PWD/../senduskv1.h \
+    $$PWD/../senduskv1global.h \
+    $$PWD/../senduskv1workingthread.h \
+    $$PWD/../usk1eventpipeline.h \
+    $$PWD/../usk1incomingcommand.h \
+    $$PWD/../usk1outgoingcommand.h \
+    $$PWD/../usk1outgoingcommandpool.h \
+    $$PWD/../usk1outgoingqueue.h \
+    $$PWD/../usk1ringbuffer.h \
+    $$PWD/../usk1rttestimator.h \
+    $$PWD/../usk1spscqueue.h \
+    $$PWD/../usk1statistics.h \
+    $$PWD/../usk1timerwheel.h \
+    $$PWD/../usk1timesyncscheduler.h \
+    $$PWD/../usk1transmitpacer.h \
+    $$PWD/../usk1win1251.h
+
+SOURCES += \
+    $$PWD/../sendusk1protocol.cpp \
+    $$PWD/../senduskv1.cpp \
+    $$PWD/../senduskv1workingthread.cpp \
+    $$PWD/../usk1eventpipeline.cpp \
+    $$PWD/../usk1incomingcommand.cpp \
+    $$PWD/../usk1outgoingcommand.cpp \
+    $$PWD/../usk1outgoingcommandpool.cpp \
+    $$PWD/../usk1outgoingqueue.cpp \
+    $$PWD/../usk1ringbuffer.cpp \
+    $$PWD/../usk1rttestimator.cpp \
+    $$PWD/../usk1timerwheel.cpp \
+    $$PWD/../usk1timesyncscheduler.cpp \
+    $$PWD/../usk1transmitpacer.cpp \
+    $$PWD/../usk1win1251.cpp
+
+linux {
+    HEADERS += $$PWD/../usk1nativeserialport.h
+    SOURCES += $$PWD/../usk1nativeserialport.cpp
+}
@@ -0,0 +1,10 @@
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    usk1incomingcommand \
+    usk1outgoingcommand
+
+# имитатор УСК на псевдотерминале
+linux {
+    SUBDIRS += senduskv1
+}
@@ -0,0 +1,230 @@
+#include <QtTest>
+#include <QTextCodec>
+#include <QRegExp>
+#include <QRandomGenerator>
+#include "usk1incomingcommand.h"
+#include "sendusk1protocol.h"
+#include "senduskv1global.h"
+
+// сверка сигнатур, сравниваемых по байтам CP1251, с прежним разбором
+// через QTextCodec, QString::toLower()/trimmed() и QRegExp
+namespace {
+
+QString oldMessage(const QByteArray &text)
+{
+    static QTextCodec *codec = QTextCodec::codecForName("Windows-1251");
+    return codec->toUnicode(text);
+}
+
+QByteArray toWin1251(const QString &text)
+{
+    static QTextCodec *codec = QTextCodec::codecForName("Windows-1251");
+    return codec->fromUnicode(text);
+}
+
+bool oldIsReset(const QByteArray &text)
+{
+    return oldMessage(text).trimmed().toLower() == QString::fromUtf8("полный сброс уск");
+}
+
+bool oldIsNewKpu(const QByteArray &text)
+{
+    return oldMessage(text).toLower().left(9) == QString::fromUtf8("новый оу:");
+}
+
+bool oldIsDisconnectedKpu(const QByteArray &text)
+{
+    return oldMessage(text).toLower().left(9) == QString::fromUtf8("неисп.оу:");
+}
+
+bool oldIsSensorChange(const QByteArray &text)
+{
+    const QString message = oldMessage(text).toLower();
+    return message.mid(0, 2) == "l=" && message.mid(4, 2) == "k=";
+}
+
+bool oldVoltage(const QByteArray &text, int &numOutput, bool &on)
+{
+    const QString message = oldMessage(text).toLower().trimmed();
+    QRegExp re("\\b(\\w+) 220-([12])\\b");
+    if (re.indexIn(message) < 0) {
+        return false;
+    }
+    numOutput = re.cap(2).toInt();
+    if (re.cap(1) == QString::fromUtf8("включение")) {
+        on = true;
+        return true;
+    }
+    if (re.cap(1) == QString::fromUtf8("выключение")) {
+        on = false;
+        return true;
+    }
+    return false;
+}
+
+int oldInfoPacket(const QByteArray &text)
+{
+    const QString message = oldMessage(text).toLower().trimmed();
+    if (message == QString::fromUtf8("включение уск")) {
+        return SendUSKv1Namespace::packetUskOn;
+    }
+    if (message == QString::fromUtf8("установка часов")) {
+        return SendUSKv1Namespace::packetUskSettingTime;
+    }
+    if (message == QString::fromUtf8("ошибка приема rs")) {
+        return SendUSKv1Namespace::packetUskErrorReceivingRS;
+    }
+    return -1;
+}
+
+QByteArray makePacket(const QByteArray &text)
+{
+    QByteArray packet(Usk1IncomingPacket::PacketSize, '\0');
+    packet[0] = 0x01;
+    for (int i = 0; i < Usk1IncomingPacket::DataSize; ++i) {
+        packet[Usk1IncomingPacket::DataOffset + i] = i < text.size() ? text.at(i) : ' ';
+    }
+    char crc = 0;
+    for (int i = 0; i < Usk1IncomingPacket::PacketSize - 1; ++i) {
+        crc += packet.at(i);
+    }
+    packet[Usk1IncomingPacket::PacketSize - 1] = crc;
+    return packet;
+}
+
+const char *const signatureTexts[] = {
+    "полный сброс уск",
+    "новый оу:3 луч 1",
+    "неисп.оу:2 луч 4",
+    "l=1 k=2 ",
+    "l=. k=.",
+    "включение 220-1",
+    "выключение 220-2",
+    "вкл. выключение 220-1",
+    "включение 220-3",
+    "включение 220-12",
+    "включение  220-1",
+    "_включение 220-1",
+    "µвключение 220-2",
+    "включение уск",
+    "установка часов",
+    "ошибка приема rs",
+    "новый оу",
+    "неисп оу:",
+    "сброс уск"
+};
+
+} // namespace
+
+class Usk1IncomingCommandTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void signatures_data();
+    void signatures();
+    void randomTexts();
+
+private:
+    void compareWithOldLogic(const QByteArray &text);
+
+    SendUsk1Protocol m_protocol;
+};
+
+void Usk1IncomingCommandTest::signatures_data()
+{
+    QTest::addColumn<QByteArray>("text");
+    for (const char *signatureText : signatureTexts) {
+        const QString text = QString::fromUtf8(signatureText);
+        QString mixedCase = text;
+        for (int i = 0; i < mixedCase.size(); i += 2) {
+            mixedCase[i] = mixedCase.at(i).toUpper();
+        }
+        QTest::newRow(qPrintable(text)) << toWin1251(text);
+        QTest::newRow(qPrintable(text + " (upper)")) << toWin1251(text.toUpper());
+        QTest::newRow(qPrintable(text + " (mixed)")) << toWin1251(mixedCase);
+        QTest::newRow(qPrintable(text + " (spaces)")) << toWin1251(" " + text + "\t");
+        QTest::newRow(qPrintable(text + " (nbsp)")) << QByteArray("\xa0") + toWin1251(mixedCase) + "\r";
+    }
+}
+
+void Usk1IncomingCommandTest::signatures()
+{
+    QFETCH(QByteArray, text);
+    compareWithOldLogic(text);
+}
+
+void Usk1IncomingCommandTest::randomTexts()
+{
+    // сигнатуры с произвольным регистром, пробельными символами и заменой
+    // одного байта, а также полностью случайные данные
+    static const char blanks[] = {' ', '\t', '\r', '\n', '\xa0'};
+    QRandomGenerator random(20161017);
+    for (int n = 0; n < 100000; ++n) {
+        QByteArray text;
+        if (random.bounded(10) < 3) {
+            for (int i = 0; i < Usk1IncomingPacket::DataSize; ++i) {
+                text.append(static_cast<char>(random.bounded(256)));
+            }
+        } else {
+            QString signature = QString::fromUtf8(signatureTexts[random.bounded(int(sizeof(signatureTexts) / sizeof(signatureTexts[0])))]);
+            for (int i = 0; i < signature.size(); ++i) {
+                if (random.bounded(2)) {
+                    signature[i] = signature.at(i).toUpper();
+                }
+            }
+            for (int i = random.bounded(3); i > 0; --i) {
+                text.append(blanks[random.bounded(int(sizeof(blanks)))]);
+            }
+            text.append(toWin1251(signature));
+            for (int i = random.bounded(4); i > 0; --i) {
+                text.append(random.bounded(2) ? blanks[random.bounded(int(sizeof(blanks)))] : static_cast<char>(random.bounded(256)));
+            }
+            if (random.bounded(5) == 0) {
+                text[random.bounded(text.size())] = static_cast<char>(random.bounded(256));
+            }
+        }
+        compareWithOldLogic(text.left(Usk1IncomingPacket::DataSize));
+        if (QTest::currentTestFailed()) {
+            qWarning() << "text:" << text.left(Usk1IncomingPacket::DataSize).toHex();
+            return;
+        }
+    }
+}
+
+void Usk1IncomingCommandTest::compareWithOldLogic(const QByteArray &text)
+{
+    const QByteArray packetData = makePacket(text);
+    const Usk1IncomingPacket packet(packetData.constData(), packetData.size());
+    QVERIFY(packet.isCorrectPacket());
+
+    QCOMPARE(ResetUsk1IncomingCommand().isMyPacket(packet), oldIsReset(text));
+    QCOMPARE(NewKpuUsk1IncomingCommand().isMyPacket(packet), oldIsNewKpu(text));
+    QCOMPARE(DisconnectedKpuUsk1IncomingCommand().isMyPacket(packet), oldIsDisconnectedKpu(text));
+    QCOMPARE(SensorChangeUsk1IncomingCommand().isMyPacket(packet), oldIsSensorChange(text));
+
+    int numOutput = 0;
+    bool on = false;
+    const bool voltage = oldVoltage(text, numOutput, on);
+    QCOMPARE(VoltageStatusChangedUsk1IncomingCommand().isMyPacket(packet), voltage);
+    if (voltage) {
+        QSignalSpy spy(&m_protocol, &SendUsk1Protocol::voltageStatusChanged);
+        VoltageStatusChangedUsk1IncomingCommand().informAboutCommand(&m_protocol, packet);
+        QCOMPARE(spy.count(), 1);
+        QCOMPARE(spy.at(0).at(1).toInt(), numOutput);
+        QCOMPARE(spy.at(0).at(2).toBool(), on);
+    }
+
+    const int info = oldInfoPacket(text);
+    QCOMPARE(InfoUsk1IncomingCommand().isMyPacket(packet), info >= 0);
+    if (info >= 0) {
+        QSignalSpy spy(&m_protocol, &SendUsk1Protocol::uskInfoPacketReceived);
+        InfoUsk1IncomingCommand().informAboutCommand(&m_protocol, packet);
+        QCOMPARE(spy.count(), 1);
+        QCOMPARE(spy.at(0).at(1).toInt(), info);
+    }
+}
+
+QTEST_GUILESS_MAIN(Usk1IncomingCommandTest)
+
+#include "tst_usk1incomingcommand.moc"
@@ -0,0 +1,292 @@
+#include <QtTest>
+#include <QTextCodec>
+#include "usk1outgoingcommand.h"
+#include "senduskv1global.h"
+
+// сверка кадров, кодируемых в std::array, с прежними кодировщиками
+// outgoingBinaryPacket() на QByteArray/QTextCodec; байт приоритета
+// в прежних кадрах был всегда 0 и здесь подставляется явно
+namespace {
+
+QTextCodec *win1251()
+{
+    static QTextCodec *codec = QTextCodec::codecForName("Windows-1251");
+    return codec;
+}
+
+QByteArray oldFirstPartOfPacket(const int uskNum, const quint64 flags, const quint8 priority)
+{
+    QByteArray res;
+    res.append(static_cast<char>(0x00));
+    res.append(static_cast<char>(uskNum & 0xff));
+    res.append(static_cast<char>((uskNum >> 8) & 0xff));
+    res.append(static_cast<char>(flags & 0xff));
+    res.append(static_cast<char>((flags >> 8) & 0xff));
+    res.append(static_cast<char>((flags >> 16) & 0xff));
+    res.append(static_cast<char>((flags >> 24) & 0xff));
+    res.append(static_cast<char>(priority));
+    return res;
+}
+
+void oldAppendCrc(QByteArray &packet)
+{
+    char crc = 0x00;
+    for (int i = 0; i < packet.length(); ++i)
+        crc += packet.at(i);
+    packet.append(crc);
+}
+
+QByteArray oldSendTimePacket(const int uskNum, const quint8 priority, const QDateTime &dateTime)
+{
+    QByteArray res = oldFirstPartOfPacket(uskNum, 2, priority);
+    QString stringDate;
+    stringDate.append(QString("%0").arg(dateTime.date().day(), 2, 10, QChar('0'))).append('/')
+            .append(QString("%0").arg(dateTime.date().month(), 2, 10, QChar('0'))).append('/')
+            .append(QString::number(dateTime.date().year() % 10)).append(' ')
+            .append(QString("%0").arg(dateTime.time().hour(), 2, 10, QChar('0'))).append(':')
+            .append(QString("%0").arg(dateTime.time().minute(), 2, 10, QChar('0'))).append(':')
+            .append(QString("%0").arg(dateTime.time().second(), 2, 10, QChar('0')));
+    res.append(stringDate.toLatin1());
+    res.append(static_cast<char>(0x00));
+    res.append(static_cast<char>(0x00));
+    oldAppendCrc(res);
+    return res;
+}
+
+QByteArray oldSendMessagePacket(const int uskNum, const quint8 priority, const QString &message)
+{
+    QByteArray res = oldFirstPartOfPacket(uskNum, 0x00000004, priority);
+    QByteArray cp1251Message;
+    cp1251Message.resize(16);
+    cp1251Message.fill(' ');
+    cp1251Message.replace(0, message.length() > 16 ? 16 : message.length(), win1251()->fromUnicode(message.left(16)));
+    res.append(cp1251Message);
+    res.append(static_cast<char>(0x00));
+    res.append(static_cast<char>(0x00));
+    oldAppendCrc(res);
+    return res;
+}
+
+QByteArray oldResetPacket(const int uskNum, const quint8 priority)
+{
+    QByteArray res;
+    res.resize(26);
+    res.fill(static_cast<char>(0x00));
+    res[1] = static_cast<char>(uskNum & 0xff);
+    res[2] = static_cast<char>((uskNum >> 8) & 0xff);
+    res[3] = 0x01;
+    res[7] = static_cast<char>(priority);
+    oldAppendCrc(res);
+    return res;
+}
+
+QByteArray oldChangeRelayPacket(const int uskNum, const quint8 priority, const int rayNum,
+                                const int kpuNum, const int sensorNum, const int relayStatus)
+{
+    QByteArray res = oldFirstPartOfPacket(uskNum, 0x00001000, priority);
+    QString textCommand = QString::fromUtf8("КПУ %0/%1/%2/%3")
+            .arg(rayNum % 10)
+            .arg(kpuNum % 10)
+            .arg(sensorNum % 10)
+            .arg(relayStatus == 1 ? QString::fromUtf8("Вкл 0 ") : QString::fromUtf8("Выкл 0"));
+    res.append(win1251()->fromUnicode(textCommand));
+    res.append(static_cast<char>(rayNum));
+    res.append(static_cast<char>(kpuNum * 0x10 + ((sensorNum - 1) << 1) + relayStatus));
+    oldAppendCrc(res);
+    return res;
+}
+
+QByteArray oldChangeVoltagePacket(const int uskNum, const quint8 priority, const int numOutput, const bool on)
+{
+    quint64 flag;
+    switch (numOutput) {
+    case 2:
+        flag = on ? 0x00002000 : 0x00004000;
+        break;
+    default:
+        flag = on ? 0x00000020 : 0x00000100;
+        break;
+    }
+    QByteArray res = oldFirstPartOfPacket(uskNum, flag, priority);
+    res.append("                ");
+    res.append(static_cast<char>(0x00));
+    res.append(static_cast<char>(0x00));
+    oldAppendCrc(res);
+    return res;
+}
+
+QByteArray frameBytes(Usk1OutgoingCommand &command)
+{
+    const Usk1OutgoingCommand::Frame &frame = command.frame();
+    return QByteArray(reinterpret_cast<const char *>(frame.data()), Usk1OutgoingCommand::FrameSize);
+}
+
+const int uskNumbers[] = {0, 1, 7, 255, 256, 4660, 65535};
+const quint8 priorities[] = {SendUSKv1Namespace::priorityLow, SendUSKv1Namespace::priorityHigh};
+
+} // namespace
+
+class Usk1OutgoingCommandTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void sendTime();
+    void sendMessage();
+    void reset();
+    void changeRelay();
+    void changeVoltage();
+    void cachedFrameFollowsPriority();
+
+private:
+    void compare(Usk1OutgoingCommand &command, const quint8 priority, const QByteArray &expected);
+};
+
+void Usk1OutgoingCommandTest::compare(Usk1OutgoingCommand &command, const quint8 priority, const QByteArray &expected)
+{
+    command.setPriority(priority);
+    QCOMPARE(expected.size(), int(Usk1OutgoingCommand::FrameSize));
+    QCOMPARE(command.outgoingBinaryPacket().toHex(), expected.toHex());
+    QCOMPARE(frameBytes(command).toHex(), expected.toHex());
+    // повторная отправка берёт тот же кадр
+    QCOMPARE(frameBytes(command).toHex(), expected.toHex());
+}
+
+void Usk1OutgoingCommandTest::sendTime()
+{
+    // время кадра отсчитывается от постановки в очередь, поэтому берём
+    // начало секунды: за время теста она не сменится
+    const qint64 epochSeconds[] = {0, Q_INT64_C(1476712800), Q_INT64_C(1609459199),
+                                   Q_INT64_C(951782400), Q_INT64_C(4102444799)};
+    const int offsets[] = {0, 3 * 3600, -5 * 3600, 5 * 3600 + 1800};
+    for (const int uskNum : uskNumbers) {
+        for (const quint8 priority : priorities) {
+            for (const qint64 epochSecond : epochSeconds) {
+                for (const int offset : offsets) {
+                    const QDateTime dateTime = QDateTime::fromMSecsSinceEpoch(epochSecond * 1000, Qt::OffsetFromUTC, offset);
+                    SendTimeUsk1OutgoingCommand command(nullptr, uskNum, 1, dateTime);
+                    compare(command, priority, oldSendTimePacket(uskNum, priority, dateTime));
+                    if (QTest::currentTestFailed()) {
+                        qWarning() << uskNum << priority << dateTime;
+                        return;
+                    }
+                }
+            }
+            // локальное время - как передаёт SendUsk1Protocol::sendTime()
+            QDateTime now = QDateTime::currentDateTime();
+            now.setTime(QTime(now.time().hour(), now.time().minute(), now.time().second()));
+            SendTimeUsk1OutgoingCommand command(nullptr, uskNum, 1, now);
+            compare(command, priority, oldSendTimePacket(uskNum, priority, now));
+            if (QTest::currentTestFailed()) {
+                return;
+            }
+        }
+    }
+}
+
+void Usk1OutgoingCommandTest::sendMessage()
+{
+    const char *const messages[] = {
+        "",
+        "hello",
+        "Привет мир",
+        "ровно шестнадцат",
+        "0123456789abcdefXYZ",
+        "ЁёЇїЎў№€‰«»",
+        "中文 test"
+    };
+    for (const int uskNum : uskNumbers) {
+        for (const quint8 priority : priorities) {
+            for (const char *text : messages) {
+                const QString message = QString::fromUtf8(text);
+                SendMessageUsk1OutgoingCommand command(nullptr, uskNum, 1, message);
+                compare(command, priority, oldSendMessagePacket(uskNum, priority, message));
+                if (QTest::currentTestFailed()) {
+                    qWarning() << uskNum << priority << message;
+                    return;
+                }
+            }
+        }
+    }
+}
+
+void Usk1OutgoingCommandTest::reset()
+{
+    for (const int uskNum : uskNumbers) {
+        for (const quint8 priority : priorities) {
+            ResetUsk1OutgoingCommand command(nullptr, uskNum, 1);
+            compare(command, priority, oldResetPacket(uskNum, priority));
+            if (QTest::currentTestFailed()) {
+                qWarning() << uskNum << priority;
+                return;
+            }
+        }
+    }
+}
+
+void Usk1OutgoingCommandTest::changeRelay()
+{
+    for (const int uskNum : uskNumbers) {
+        for (const quint8 priority : priorities) {
+            for (int rayNum = 0; rayNum <= 12; ++rayNum) {
+                for (int kpuNum = 0; kpuNum <= 15; ++kpuNum) {
+                    for (int sensorNum = 1; sensorNum <= 8; ++sensorNum) {
+                        for (int relayStatus = 0; relayStatus <= 1; ++relayStatus) {
+                            ChangeRelayUsk1OutgoingCommand command(nullptr, uskNum, 1, rayNum, kpuNum,
+                                                                   sensorNum, relayStatus, QString());
+                            compare(command, priority, oldChangeRelayPacket(uskNum, priority, rayNum, kpuNum,
+                                                                            sensorNum, relayStatus));
+                            if (QTest::currentTestFailed()) {
+                                qWarning() << uskNum << priority << rayNum << kpuNum << sensorNum << relayStatus;
+                                return;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void Usk1OutgoingCommandTest::changeVoltage()
+{
+    Usk1VoltageFrames frames;
+    for (const int uskNum : uskNumbers) {
+        frames.setUskNum(uskNum);
+        for (const quint8 priority : priorities) {
+            for (int numOutput = 0; numOutput <= 3; ++numOutput) {
+                for (const bool on : {false, true}) {
+                    const QByteArray expected = oldChangeVoltagePacket(uskNum, priority, numOutput, on);
+                    ChangeVoltageUsk1OutgoingCommand command(nullptr, uskNum, 1, numOutput, on);
+                    compare(command, priority, expected);
+                    // кадр из заготовок УСК: байт приоритета и сумма правятся на месте
+                    ChangeVoltageUsk1OutgoingCommand copied(nullptr, uskNum, 1, numOutput, on, frames);
+                    compare(copied, priority, expected);
+                    if (QTest::currentTestFailed()) {
+                        qWarning() << uskNum << priority << numOutput << on;
+                        return;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void Usk1OutgoingCommandTest::cachedFrameFollowsPriority()
+{
+    // байт приоритета входит в кадр: смена приоритета после кодирования
+    // не должна оставлять в кэше прежний кадр
+    ChangeVoltageUsk1OutgoingCommand command(nullptr, 3, 1, 2, true);
+    QCOMPARE(frameBytes(command).toHex(),
+             oldChangeVoltagePacket(3, SendUSKv1Namespace::priorityLow, 2, true).toHex());
+    command.setPriority(SendUSKv1Namespace::priorityHigh);
+    QCOMPARE(frameBytes(command).toHex(),
+             oldChangeVoltagePacket(3, SendUSKv1Namespace::priorityHigh, 2, true).toHex());
+    command.setPriority(SendUSKv1Namespace::priorityLow);
+    QCOMPARE(frameBytes(command).toHex(),
+             oldChangeVoltagePacket(3, SendUSKv1Namespace::priorityLow, 2, true).toHex());
+}
+
+QTEST_GUILESS_MAIN(Usk1OutgoingCommandTest)
+
+#include "tst_usk1outgoingcommand.moc"
@@ -0,0 +1,5 @@
+TARGET = tst_usk1outgoingcommand
+
+include(../tests.pri)
+
+SOURCES += tst_usk1outgoingcommand.cpp
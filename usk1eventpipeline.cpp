@@ -0,0 +1,202 @@
+#include "usk1eventpipeline.h"
+
+// предел сна рабочего потока на заполненной очереди, мс: страховка
+// от пробуждения, разминувшегося с началом ожидания
+#define producerWaitTimeout 10
+
+Usk1Event::Usk1Event() :
+    kind(eventError),
+    enqueuedNs(0)
+{
+    args[0] = args[1] = args[2] = args[3] = 0;
+}
+
+Usk1Event::Usk1Event(const int kind, const QString &uskName, const QString &text,
+                     const int arg0, const int arg1, const int arg2, const int arg3) :
+    kind(kind),
+    enqueuedNs(0),
+    uskName(uskName),
+    text(text)
+{
+    args[0] = arg0;
+    args[1] = arg1;
+    args[2] = arg2;
+    args[3] = arg3;
+}
+
+Usk1EventPipeline::Producer::Producer() :
+    waiting(0)
+{
+}
+
+Usk1EventPipeline::Usk1EventPipeline(const bool staged, QObject *parent) :
+    QObject(parent),
+    m_staged(staged),
+    m_drainScheduled(0),
+    m_wakeups(0)
+{
+    m_clock.start();
+}
+
+Usk1EventPipeline::~Usk1EventPipeline()
+{
+    qDeleteAll(m_producers);
+}
+
+bool Usk1EventPipeline::isStaged() const
+{
+    return m_staged;
+}
+
+int Usk1EventPipeline::addProducer()
+{
+    m_producers.append(new Producer());
+    return m_producers.size() - 1;
+}
+
+void Usk1EventPipeline::post(const int producer, Usk1Event &event)
+{
+    Producer *target = m_producers.at(producer);
+    if (!m_staged) {
+        ++target->statistics.events;
+        deliver(event);
+        return;
+    }
+    event.enqueuedNs = m_clock.nsecsElapsed();
+    // события не теряются: при заполненной очереди рабочий поток спит до выборки
+    if (!target->queue.push(event)) {
+        ++target->statistics.producerStalls;
+        QMutexLocker locker(&target->mutex);
+        target->waiting.fetchAndStoreOrdered(1);
+        while (!target->queue.push(event)) {
+            scheduleDrain();
+            target->spaceAvailable.wait(&target->mutex, producerWaitTimeout);
+        }
+        target->waiting.fetchAndStoreOrdered(0);
+    }
+    scheduleDrain();
+}
+
+Usk1PipelineStatistics Usk1EventPipeline::statistics() const
+{
+    Usk1PipelineStatistics retVal;
+    retVal.wakeups = m_wakeups;
+    for (const Producer *producer : m_producers) {
+        const Usk1PipelineStatistics &statistics = producer->statistics;
+        retVal.events += statistics.events;
+        retVal.producerStalls += statistics.producerStalls;
+        retVal.queueDepth += producer->queue.size();
+        retVal.maxQueueDepth = qMax(retVal.maxQueueDepth, statistics.maxQueueDepth);
+        retVal.totalLatencyUs += statistics.totalLatencyUs;
+        retVal.maxLatencyUs = qMax(retVal.maxLatencyUs, statistics.maxLatencyUs);
+    }
+    return retVal;
+}
+
+void Usk1EventPipeline::drain()
+{
+    // флаг снимается до выборки: событие, положенное во время выборки,
+    // либо будет выбрано сейчас, либо запросит новую. Снимается обменом:
+    // простая запись с release может уйти после чтения очередей ниже
+    m_drainScheduled.fetchAndStoreOrdered(0);
+    ++m_wakeups;
+    bool pending = false;
+    Usk1Event event;
+    for (Producer *producer : m_producers) {
+        // за проход из очереди берётся не больше, чем в ней было -
+        // занятый рабочий поток не задерживает события остальных
+        int depth = producer->queue.size();
+        Usk1PipelineStatistics &statistics = producer->statistics;
+        statistics.maxQueueDepth = qMax(statistics.maxQueueDepth, depth);
+        while (depth > 0 && producer->queue.pop(event)) {
+            --depth;
+            const qint64 latencyUs = (m_clock.nsecsElapsed() - event.enqueuedNs) / 1000;
+            ++statistics.events;
+            statistics.totalLatencyUs += latencyUs;
+            statistics.maxLatencyUs = qMax(statistics.maxLatencyUs, latencyUs);
+            deliver(event);
+        }
+        if (producer->waiting.loadAcquire()) {
+            QMutexLocker locker(&producer->mutex);
+            producer->spaceAvailable.wakeOne();
+        }
+        pending = pending || producer->queue.size() > 0;
+    }
+    if (pending) {
+        scheduleDrain();
+    }
+}
+
+void Usk1EventPipeline::scheduleDrain()
+{
+    if (m_drainScheduled.testAndSetOrdered(0, 1)) {
+        QMetaObject::invokeMethod(this, "drain", Qt::QueuedConnection);
+    }
+}
+
+void Usk1EventPipeline::deliver(const Usk1Event &event)
+{
+    const QString &uskName = event.uskName;
+    const int *args = event.args;
+    switch (event.kind) {
+    case Usk1Event::eventError:
+        emit error(uskName, args[0]);
+        break;
+    case Usk1Event::eventUnknowCommand:
+        emit unknowCommand(uskName, event.text);
+        break;
+    case Usk1Event::eventErrorOnSendingCommand:
+        emit errorOnSendingCommand(uskName, event.text);
+        break;
+    case Usk1Event::eventCommandAccepted:
+        emit commandAccepted(uskName, event.text);
+        break;
+    case Usk1Event::eventCommandDiscarded:
+        emit commandDiscarded(uskName, event.text, args[0]);
+        break;
+    case Usk1Event::eventQueueCongested:
+        emit queueCongested(uskName, args[0] != 0);
+        break;
+    case Usk1Event::eventUskInfoPacketReceived:
+        emit uskInfoPacketReceived(uskName, args[0]);
+        break;
+    case Usk1Event::eventPortIsOpen:
+        emit portIsOpen(uskName, event.text);
+        break;
+    case Usk1Event::eventPortIsClose:
+        emit portIsClose(uskName, event.text);
+        break;
+    case Usk1Event::eventUskReset:
+        emit uskReset(uskName);
+        break;
+    case Usk1Event::eventReceivedTextMessage:
+        emit receivedTextMessage(uskName, event.text);
+        break;
+    case Usk1Event::eventUskIsPresent:
+        emit uskIsPresent(uskName, args[0] != 0, args[1] != 0);
+        break;
+    case Usk1Event::eventStartSendingCommand:
+        emit startSendingCommand(uskName, event.text);
+        break;
+    case Usk1Event::eventDetectedNewKpu:
+        emit detectedNewKpu(uskName, args[0], args[1]);
+        break;
+    case Usk1Event::eventDetectedDisconnetcedKpu:
+        emit detectedDisconnetcedKpu(uskName, args[0], args[1]);
+        break;
+    case Usk1Event::eventVoltageStatusChanged:
+        emit voltageStatusChanged(uskName, args[0], args[1] != 0);
+        break;
+    case Usk1Event::eventSensorChanged:
+        emit sensorChanged(uskName, args[0], args[1], args[2], args[3]);
+        break;
+    case Usk1Event::eventUskIsAdded:
+        emit uskIsAdded(uskName, args[0] != 0);
+        break;
+    case Usk1Event::eventUskIsDeleted:
+        emit uskIsDeleted(uskName, args[0] != 0);
+        break;
+    default:
+        break;
+    }
+}
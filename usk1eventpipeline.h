@@ -0,0 +1,127 @@
+#ifndef USK1EVENTPIPELINE_H
+#define USK1EVENTPIPELINE_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QVector>
+#include <QWaitCondition>
+
+#include "usk1spscqueue.h"
+#include "usk1statistics.h"
+
+// событие УСК для стадии доставки: вид, имя УСК, строка и до четырёх чисел
+struct Usk1Event
+{
+    enum Kinds {
+        eventError,
+        eventUnknowCommand,
+        eventErrorOnSendingCommand,
+        eventCommandAccepted,
+        eventCommandDiscarded,
+        eventQueueCongested,
+        eventUskInfoPacketReceived,
+        eventPortIsOpen,
+        eventPortIsClose,
+        eventUskReset,
+        eventReceivedTextMessage,
+        eventUskIsPresent,
+        eventStartSendingCommand,
+        eventDetectedNewKpu,
+        eventDetectedDisconnetcedKpu,
+        eventVoltageStatusChanged,
+        eventSensorChanged,
+        eventUskIsAdded,
+        eventUskIsDeleted
+    };
+
+    Usk1Event();
+    Usk1Event(const int kind, const QString &uskName, const QString &text = QString(),
+              const int arg0 = 0, const int arg1 = 0, const int arg2 = 0, const int arg3 = 0);
+
+    int kind;
+    int args[4];
+    qint64 enqueuedNs;
+    QString uskName;
+    QString text;
+};
+
+// стадия доставки событий УСК потребителям. Рабочие потоки (приём, разбор
+// и состояние протокола - одна стадия: разбор меняет состояние, от которого
+// зависит отправка) кладут события каждый в свою очередь без блокировок, так что
+// порядок событий одного УСК сохраняется. Стадия либо работает в своём потоке
+// и выбирает очереди по пробуждению, либо слита с рабочими потоками и доставляет
+// событие сразу, без очереди
+class Usk1EventPipeline : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Usk1EventPipeline(const bool staged, QObject *parent = 0);
+    ~Usk1EventPipeline();
+
+    bool isStaged() const;
+    // очередь одного рабочего потока; все - до запуска рабочих потоков
+    int addProducer();
+    // из рабочего потока producer; при заполненной очереди ждёт потока доставки
+    void post(const int producer, Usk1Event &event);
+    // не очень потокобезопасно: счётчики читаются без блокировки
+    Usk1PipelineStatistics statistics() const;
+
+public slots:
+    void drain();
+
+signals:
+    void error(const QString &uskName, int errorCode);
+    void unknowCommand(const QString &uskName, const QString &command);
+    void errorOnSendingCommand(const QString &uskName, const QString &commandDescription);
+    void commandAccepted(const QString &uskName, const QString &commandDescription);
+    void commandDiscarded(const QString &uskName, const QString &commandDescription, const int &reason);
+    void queueCongested(const QString &uskName, const bool &congested);
+    void uskInfoPacketReceived(const QString &uskName, const int &infoPacket);
+    void portIsOpen(const QString &uskName, const QString &portName);
+    void portIsClose(const QString &uskName, const QString &portName);
+    void uskReset(const QString &uskName);
+    void receivedTextMessage(const QString &uskName, const QString &textMessage);
+    void uskIsPresent(const QString &uskName, const bool &present, const bool &firstUse);
+    void startSendingCommand(const QString &uskName, const QString &commandDescription);
+    void detectedNewKpu(const QString &uskName, const int &rayNum, const int &kpuNum);
+    void detectedDisconnetcedKpu(const QString &uskName, const int &rayNum, const int &kpuNum);
+    void voltageStatusChanged(const QString &uskName, const int &outputNumber, const bool &status);
+    void sensorChanged(const QString &uskName, const int &rayNum, const int &kpuNum, const int &sensorNum, const int &state);
+    void uskIsAdded(const QString &uskName, const bool &added);
+    void uskIsDeleted(const QString &uksName, const bool &deleted);
+
+private:
+    enum {
+        QueueCapacity = 1024
+    };
+
+    // очередь рабочего потока и её счётчики: producerStalls пишет рабочий поток,
+    // остальное - поток доставки (при слитой стадии - рабочий поток)
+    struct Producer {
+        Producer();
+
+        Usk1SpscQueue<Usk1Event, QueueCapacity> queue;
+        Usk1PipelineStatistics statistics;
+        // рабочий поток спит на заполненной очереди, выборка его будит
+        QAtomicInt waiting;
+        QMutex mutex;
+        QWaitCondition spaceAvailable;
+    };
+
+    void scheduleDrain();
+    void deliver(const Usk1Event &event);
+
+private:
+    Q_DISABLE_COPY(Usk1EventPipeline)
+
+    const bool m_staged;
+    QVector<Producer *> m_producers;
+    // выборка уже запрошена у потока доставки - повторно не будим
+    QAtomicInt m_drainScheduled;
+    quint64 m_wakeups;
+    QElapsedTimer m_clock;
+};
+
+#endif // USK1EVENTPIPELINE_H
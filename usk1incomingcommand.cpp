@@ -1,54 +1,114 @@
 #include "usk1incomingcommand.h"
 #include "sendusk1protocol.h"
 #include "senduskv1global.h"
-#include <QTextCodec>
-#include <QRegExp>
+#include "usk1win1251.h"
 #include <QStringList>
 #include <QDebug>
 
-Usk1IncomingCommand::Usk1IncomingCommand(SendUsk1Protocol *protocol) :
-    m_protocol(protocol)
-{
-}
-
-bool Usk1IncomingCommand::parsePacket(const QByteArray &packet)
-{
-    m_isCorrectPacket = false;
-    if (packet.length() != 26) {
-        return false;
+// сигнатуры входящих сообщений в CP1251 (нижний регистр)
+// "полный сброс уск"
+static const Usk1Win1251::Signature resetSignature =
+        Usk1Win1251::signature("\xef\xee\xeb\xed\xfb\xe9 \xf1\xe1\xf0\xee\xf1 \xf3\xf1\xea");
+// "новый оу:"
+static const Usk1Win1251::Signature newKpuSignature =
+        Usk1Win1251::signature("\xed\xee\xe2\xfb\xe9 \xee\xf3:");
+// "неисп.оу:"
+static const Usk1Win1251::Signature disconnectedKpuSignature =
+        Usk1Win1251::signature("\xed\xe5\xe8\xf1\xef.\xee\xf3:");
+// "l=" и "k=" ("l=1 k=2 ...")
+static const Usk1Win1251::Signature sensorRaySignature = Usk1Win1251::signature("l=");
+static const Usk1Win1251::Signature sensorKpuSignature = Usk1Win1251::signature("k=");
+// "включение" / "выключение" перед " 220-N"
+static const Usk1Win1251::Signature voltageOnSignature =
+        Usk1Win1251::signature("\xe2\xea\xeb\xfe\xf7\xe5\xed\xe8\xe5");
+static const Usk1Win1251::Signature voltageOffSignature =
+        Usk1Win1251::signature("\xe2\xfb\xea\xeb\xfe\xf7\xe5\xed\xe8\xe5");
+static const Usk1Win1251::Signature voltageOutputSignature = Usk1Win1251::signature(" 220-");
+
+// первые байты сигнатур для предварительного отбора команд
+static const char resetLeadBytes[] = "\xef";
+static const char newKpuLeadBytes[] = "\xed";
+static const char disconnectedKpuLeadBytes[] = "\xed";
+static const char sensorLeadBytes[] = "l";
+static const char infoLeadBytes[] = "\xe2\xf3\xee";
+
+// флаг текстового сообщения
+static const quint32 textMessageFlag = 0x10000;
+
+struct UskInfoSignature {
+    Usk1Win1251::Signature signature;
+    int infoPacket;
+};
+
+static const UskInfoSignature uskInfoSignatures[] = {
+    // "включение уск"
+    {Usk1Win1251::signature("\xe2\xea\xeb\xfe\xf7\xe5\xed\xe8\xe5 \xf3\xf1\xea"),
+     SendUSKv1Namespace::packetUskOn},
+    // "установка часов"
+    {Usk1Win1251::signature("\xf3\xf1\xf2\xe0\xed\xee\xe2\xea\xe0 \xf7\xe0\xf1\xee\xe2"),
+     SendUSKv1Namespace::packetUskSettingTime},
+    // "ошибка приема rs"
+    {Usk1Win1251::signature("\xee\xf8\xe8\xe1\xea\xe0 \xef\xf0\xe8\xe5\xec\xe0 rs"),
+     SendUSKv1Namespace::packetUskErrorReceivingRS}
+};
+
+Usk1IncomingPacket::Usk1IncomingPacket(const char *packet, const int length) :
+    m_packet(packet),
+    m_flags(0),
+    m_uskNumber(0),
+    m_isCorrectPacket(false)
+{
+    if (!packet || length != PacketSize) {
+        return;
     }
-    char crc = 0;
-    for (int i = 0; i < 25; ++i)
-        crc += packet.at(i);
-    if (crc != packet.at(25)) {
-        return false;
+    const uchar *bytes = reinterpret_cast<const uchar *>(packet);
+    uchar crc = 0;
+    for (int i = 0; i < PacketSize - 1; ++i)
+        crc += bytes[i];
+    if (crc != bytes[PacketSize - 1]) {
+        return;
     }
-    m_uskNumber = (ushort)packet.at(0) + (ushort)packet.at(1) * 0x100;
-    m_u1 = packet.at(23);
-    m_u2 = packet.at(24);
-    m_flags = (quint32)packet.at(2) * 0x01 +
-            (quint32)packet.at(3) * 0x0100 +
-            (quint32)packet.at(4) * 0x010000 +
-            (quint32)packet.at(5) * 0x01000000;
-    m_packetData = packet.mid(7, 16);
+    m_uskNumber = bytes[0] | (bytes[1] << 8);
+    m_flags = static_cast<quint32>(bytes[2]) |
+            (static_cast<quint32>(bytes[3]) << 8) |
+            (static_cast<quint32>(bytes[4]) << 16) |
+            (static_cast<quint32>(bytes[5]) << 24);
     m_isCorrectPacket = true;
-    return m_isCorrectPacket;
 }
 
-bool Usk1IncomingCommand::isCorrectPacket() const
+bool Usk1IncomingPacket::isCorrectPacket() const
 {
     return m_isCorrectPacket;
 }
 
-QTextCodec *Usk1IncomingCommand::getWin1251TextCodec()
+ushort Usk1IncomingPacket::uskNumber() const
+{
+    return m_uskNumber;
+}
+
+quint32 Usk1IncomingPacket::flags() const
+{
+    return m_flags;
+}
+
+const char *Usk1IncomingPacket::data() const
+{
+    return m_packet + DataOffset;
+}
+
+char Usk1IncomingPacket::u1() const
 {
-    static QTextCodec *codecWin1251 = QTextCodec::codecForName("Windows-1251");
-    return codecWin1251;
+    return m_packet[23];
 }
 
+char Usk1IncomingPacket::u2() const
+{
+    return m_packet[24];
+}
 
-Usk1IncomingCommandFactory::Usk1IncomingCommandFactory(SendUsk1Protocol *protocol) :
-    m_protocol(protocol)
+
+Usk1IncomingCommandFactory::Usk1IncomingCommandFactory() :
+    m_base(nullptr)
 {
     registerClass<BadUsk1IncomingCommand>(0);
     registerClass<UnknowUsk1IncomingCommand>(65535);
@@ -61,312 +121,431 @@ Usk1IncomingCommandFactory::Usk1IncomingCommandFactory(SendUsk1Protocol *protoco
     registerClass<InfoUsk1IncomingCommand>(10);
 }
 
-Usk1IncomingCommandSharedPtr Usk1IncomingCommandFactory::getCommandByPacket(const QByteArray &packet)
+Usk1IncomingCommandFactory::Usk1IncomingCommandFactory(const Usk1IncomingCommandFactory *base) :
+    m_base(base)
+{
+    rebuildDispatch();
+}
+
+const Usk1IncomingCommandFactory &Usk1IncomingCommandFactory::defaultFactory()
+{
+    static const Usk1IncomingCommandFactory factory;
+    return factory;
+}
+
+Usk1IncomingCommandFactory::~Usk1IncomingCommandFactory()
+{
+    for (const Entry &entry : m_commands) {
+        delete entry.command;
+    }
+}
+
+void Usk1IncomingCommandFactory::registerCommand(const int priority, Usk1IncomingCommand *command)
+{
+    if (!command) {
+        return;
+    }
+    // вставляем после всех команд с таким же приоритетом,
+    // чтобы сохранить порядок регистрации
+    int pos = m_commands.count();
+    while (pos > 0 && m_commands.at(pos - 1).priority > priority) {
+        --pos;
+    }
+    Entry entry;
+    entry.priority = priority;
+    entry.command = command;
+    m_commands.insert(pos, entry);
+    rebuildDispatch();
+}
+
+const Usk1IncomingCommand *Usk1IncomingCommandFactory::getCommandByPacket(const Usk1IncomingPacket &packet) const
+{
+    // в наборе кандидатов только команды, которые могут подойти пакету,
+    // в том же порядке, что и в общем списке - первая подходящая та же
+    const QVector<Candidate> &candidates =
+            packet.isCorrectPacket() ? m_candidates[leadByte(packet)] : m_incorrectCandidates;
+    const quint32 flags = packet.flags();
+    for (const Candidate &candidate : candidates) {
+        if ((flags & candidate.requiredFlags) == candidate.requiredFlags &&
+                candidate.command->isMyPacket(packet)) {
+            return candidate.command;
+        }
+    }
+    return nullptr;
+}
+
+void Usk1IncomingCommandFactory::rebuildDispatch()
 {
-    qDebug() << Q_FUNC_INFO;
-    QMapIterator<int, QList<producedFunction> > i(m_functions);
-    QList<int> priorities = m_functions.keys();
-    for (const int &priority: priorities) {
-        QList<producedFunction> listOfFunctions = m_functions.value(priority);
-        for (producedFunction fn: listOfFunctions) {
-            Usk1IncomingCommandSharedPtr command = fn();
-            if (command->isMyPacket(packet)) {
-                return command;
+    for (QVector<Candidate> &candidates : m_candidates) {
+        candidates.clear();
+    }
+    m_incorrectCandidates.clear();
+    // слияние по приоритету с базовой фабрикой; при равном приоритете
+    // её команды зарегистрированы раньше и проверяются первыми
+    static const QVector<Entry> noCommands;
+    const QVector<Entry> &baseCommands = m_base ? m_base->m_commands : noCommands;
+    int own = 0;
+    int base = 0;
+    while (own < m_commands.count() || base < baseCommands.count()) {
+        const bool takeBase = base < baseCommands.count() &&
+                (own >= m_commands.count() || baseCommands.at(base).priority <= m_commands.at(own).priority);
+        const Entry &entry = takeBase ? baseCommands.at(base++) : m_commands.at(own++);
+        const Usk1IncomingDispatchKey key = entry.command->dispatchKey();
+        Candidate candidate;
+        candidate.requiredFlags = key.requiredFlags;
+        candidate.command = entry.command;
+        if (key.validity != Usk1IncomingDispatchKey::correctPacket) {
+            m_incorrectCandidates.append(candidate);
+        }
+        if (key.validity == Usk1IncomingDispatchKey::incorrectPacket) {
+            continue;
+        }
+        if (!key.leadBytes) {
+            for (QVector<Candidate> &candidates : m_candidates) {
+                candidates.append(candidate);
+            }
+            continue;
+        }
+        for (const char *lead = key.leadBytes; *lead; ++lead) {
+            QVector<Candidate> &candidates = m_candidates[Usk1Win1251::toLower(*lead)];
+            // один и тот же байт может встретиться в ключе дважды
+            if (candidates.isEmpty() || candidates.last().command != entry.command) {
+                candidates.append(candidate);
             }
         }
     }
-    return Usk1IncomingCommandSharedPtr(nullptr);
+}
 
+uchar Usk1IncomingCommandFactory::leadByte(const Usk1IncomingPacket &packet)
+{
+    // данные из одних пробелов попадают в набор для ' ': туда
+    // не записана ни одна команда с ограничением по первому байту
+    const char *data = packet.data();
+    for (int i = 0; i < Usk1IncomingPacket::DataSize; ++i) {
+        if (!Usk1Win1251::isSpace(data[i])) {
+            return Usk1Win1251::toLower(data[i]);
+        }
+    }
+    return ' ';
 }
 
 
-UnknowUsk1IncomingCommand::UnknowUsk1IncomingCommand(SendUsk1Protocol *protocol) :
-    Usk1IncomingCommand(protocol)
+Usk1IncomingDispatchKey Usk1IncomingCommand::dispatchKey() const
 {
+    return Usk1IncomingDispatchKey{Usk1IncomingDispatchKey::anyPacket, 0, nullptr};
+}
 
+
+bool UnknowUsk1IncomingCommand::isMyPacket(const Usk1IncomingPacket &packet) const
+{
+    return packet.isCorrectPacket();
 }
 
-bool UnknowUsk1IncomingCommand::isMyPacket(const QByteArray &packet)
+Usk1IncomingDispatchKey UnknowUsk1IncomingCommand::dispatchKey() const
 {
-    return parsePacket(packet);
+    return Usk1IncomingDispatchKey{Usk1IncomingDispatchKey::correctPacket, 0, nullptr};
 }
 
-QString UnknowUsk1IncomingCommand::description() const
+QString UnknowUsk1IncomingCommand::description(const Usk1IncomingPacket &packet) const
 {
-    QString message = getWin1251TextCodec()->toUnicode(m_packetData);
+    QString message = Usk1Win1251::toUnicode(packet.data(), Usk1IncomingPacket::DataSize);
     return QObject::trUtf8("неизвестная входящая комманда: %0").arg(message);
 }
 
-void UnknowUsk1IncomingCommand::informAboutCommand()
+void UnknowUsk1IncomingCommand::informAboutCommand(SendUsk1Protocol *protocol, const Usk1IncomingPacket &packet) const
 {
-    QString message = getWin1251TextCodec()->toUnicode(m_packetData);
-    if (m_protocol) {
-        m_protocol->onUnknowCommand(message);
+    QString message = Usk1Win1251::toUnicode(packet.data(), Usk1IncomingPacket::DataSize);
+    if (protocol) {
+        protocol->onUnknowCommand(message);
     }
 }
 
 
-BadUsk1IncomingCommand::BadUsk1IncomingCommand(SendUsk1Protocol *protocol) :
-    Usk1IncomingCommand(protocol)
+bool BadUsk1IncomingCommand::isMyPacket(const Usk1IncomingPacket &packet) const
 {
-
+    return !packet.isCorrectPacket();
 }
 
-bool BadUsk1IncomingCommand::isMyPacket(const QByteArray &packet)
+Usk1IncomingDispatchKey BadUsk1IncomingCommand::dispatchKey() const
 {
-    return !parsePacket(packet);
+    return Usk1IncomingDispatchKey{Usk1IncomingDispatchKey::incorrectPacket, 0, nullptr};
 }
 
-QString BadUsk1IncomingCommand::description() const
+QString BadUsk1IncomingCommand::description(const Usk1IncomingPacket &packet) const
 {
+    Q_UNUSED(packet)
     return QObject::trUtf8("неверный входящий пакет (не сошлась контрольная сумма)");
 }
 
-void BadUsk1IncomingCommand::informAboutCommand()
+void BadUsk1IncomingCommand::informAboutCommand(SendUsk1Protocol *protocol, const Usk1IncomingPacket &packet) const
 {
-    if (m_protocol) {
-        m_protocol->onError(SendUSKv1Namespace::errorUskWrongPacket);
+    Q_UNUSED(packet)
+    if (protocol) {
+        protocol->onError(SendUSKv1Namespace::errorUskWrongPacket);
     }
 }
 
 
-ResetUsk1IncomingCommand::ResetUsk1IncomingCommand(SendUsk1Protocol *protocol) :
-    Usk1IncomingCommand(protocol)
+bool ResetUsk1IncomingCommand::isMyPacket(const Usk1IncomingPacket &packet) const
 {
-
+    if (!packet.isCorrectPacket()) {
+        return false;
+    }
+    return Usk1Win1251::equalsTrimmed(packet.data(), Usk1IncomingPacket::DataSize, resetSignature);
 }
 
-bool ResetUsk1IncomingCommand::isMyPacket(const QByteArray &packet)
+Usk1IncomingDispatchKey ResetUsk1IncomingCommand::dispatchKey() const
 {
-    if (!parsePacket(packet)) {
-        return false;
-    }
-    QString message = getWin1251TextCodec()->toUnicode(m_packetData).trimmed().toLower();
-    return message == QString("полный сброс уск");
+    return Usk1IncomingDispatchKey{Usk1IncomingDispatchKey::correctPacket, 0, resetLeadBytes};
 }
 
-QString ResetUsk1IncomingCommand::description() const
+QString ResetUsk1IncomingCommand::description(const Usk1IncomingPacket &packet) const
 {
+    Q_UNUSED(packet)
     return QObject::trUtf8("входящая команда: 'сброс УСК'");
 }
 
-void ResetUsk1IncomingCommand::informAboutCommand()
+void ResetUsk1IncomingCommand::informAboutCommand(SendUsk1Protocol *protocol, const Usk1IncomingPacket &packet) const
 {
-    if (m_protocol) {
-        m_protocol->onResetUskCommand();
+    Q_UNUSED(packet)
+    if (protocol) {
+        protocol->onResetUskCommand();
     }
 }
 
 
-TextMessageUsk1IncomingCommand::TextMessageUsk1IncomingCommand(SendUsk1Protocol *protocol) :
-    Usk1IncomingCommand(protocol)
+bool TextMessageUsk1IncomingCommand::isMyPacket(const Usk1IncomingPacket &packet) const
 {
-
+    if (!packet.isCorrectPacket()) {
+        return false;
+    }
+    return packet.flags() & textMessageFlag;
 }
 
-bool TextMessageUsk1IncomingCommand::isMyPacket(const QByteArray &packet)
+Usk1IncomingDispatchKey TextMessageUsk1IncomingCommand::dispatchKey() const
 {
-    if (!parsePacket(packet)) {
-        return false;
-    }
-    return m_flags & 0x10000;
+    return Usk1IncomingDispatchKey{Usk1IncomingDispatchKey::correctPacket, textMessageFlag, nullptr};
 }
 
-QString TextMessageUsk1IncomingCommand::description() const
+QString TextMessageUsk1IncomingCommand::description(const Usk1IncomingPacket &packet) const
 {
-    QString message = getWin1251TextCodec()->toUnicode(m_packetData);
+    QString message = Usk1Win1251::toUnicode(packet.data(), Usk1IncomingPacket::DataSize);
     return QObject::trUtf8("входящая команда: текстовое сообщение '%0'")
             .arg(message);
 }
 
-void TextMessageUsk1IncomingCommand::informAboutCommand()
+void TextMessageUsk1IncomingCommand::informAboutCommand(SendUsk1Protocol *protocol, const Usk1IncomingPacket &packet) const
 {
-    QString message = getWin1251TextCodec()->toUnicode(m_packetData);
-    if (m_protocol) {
-        m_protocol->onReceivedTextMessage(message);
+    QString message = Usk1Win1251::toUnicode(packet.data(), Usk1IncomingPacket::DataSize);
+    if (protocol) {
+        protocol->onReceivedTextMessage(message);
     }
 }
 
-NewKpuUsk1IncomingCommand::NewKpuUsk1IncomingCommand(SendUsk1Protocol *protocol) :
-    Usk1IncomingCommand(protocol),
-    m_kpuNum(0),
-    m_rayNum(0)
-{
 
+bool NewKpuUsk1IncomingCommand::isMyPacket(const Usk1IncomingPacket &packet) const
+{
+    return packet.isCorrectPacket() &&
+            Usk1Win1251::startsWith(packet.data(), Usk1IncomingPacket::DataSize, newKpuSignature);
 }
 
-bool NewKpuUsk1IncomingCommand::isMyPacket(const QByteArray &packet)
+Usk1IncomingDispatchKey NewKpuUsk1IncomingCommand::dispatchKey() const
 {
-    bool retVal = false;
-    if (parsePacket(packet)) {
-        QString message = getWin1251TextCodec()->toUnicode(m_packetData).toLower();
-        retVal = message.left(9) == QString("новый оу:");
-        if (retVal) {
-            m_rayNum = QString(message.at(15)).toInt();
-            m_kpuNum = QString(message.at(9)).toInt();
-        }
-    }
-    return retVal;
+    return Usk1IncomingDispatchKey{Usk1IncomingDispatchKey::correctPacket, 0, newKpuLeadBytes};
 }
 
-QString NewKpuUsk1IncomingCommand::description() const
+QString NewKpuUsk1IncomingCommand::description(const Usk1IncomingPacket &packet) const
 {
     return QObject::trUtf8("входящая команда: 'обнаружено новое КПУ: луч %0, номер КПУ %1 '")
-            .arg(m_rayNum)
-            .arg(m_kpuNum);
+            .arg(rayNum(packet))
+            .arg(kpuNum(packet));
 }
 
-void NewKpuUsk1IncomingCommand::informAboutCommand()
+void NewKpuUsk1IncomingCommand::informAboutCommand(SendUsk1Protocol *protocol, const Usk1IncomingPacket &packet) const
 {
-    if (m_protocol) {
-        m_protocol->onDetectedNewKpu(m_rayNum, m_kpuNum);
+    if (protocol) {
+        protocol->onDetectedNewKpu(rayNum(packet), kpuNum(packet));
     }
 }
 
+int NewKpuUsk1IncomingCommand::rayNum(const Usk1IncomingPacket &packet)
+{
+    return Usk1Win1251::digitValue(packet.data()[15]);
+}
 
-DisconnectedKpuUsk1IncomingCommand::DisconnectedKpuUsk1IncomingCommand(SendUsk1Protocol *protocol) :
-    Usk1IncomingCommand(protocol),
-    m_kpuNum(0),
-    m_rayNum(0)
+int NewKpuUsk1IncomingCommand::kpuNum(const Usk1IncomingPacket &packet)
 {
+    return Usk1Win1251::digitValue(packet.data()[9]);
+}
 
+
+bool DisconnectedKpuUsk1IncomingCommand::isMyPacket(const Usk1IncomingPacket &packet) const
+{
+    return packet.isCorrectPacket() &&
+            Usk1Win1251::startsWith(packet.data(), Usk1IncomingPacket::DataSize, disconnectedKpuSignature);
 }
 
-bool DisconnectedKpuUsk1IncomingCommand::isMyPacket(const QByteArray &packet)
+Usk1IncomingDispatchKey DisconnectedKpuUsk1IncomingCommand::dispatchKey() const
 {
-    bool retVal = false;
-    if (parsePacket(packet)) {
-        QString message = getWin1251TextCodec()->toUnicode(m_packetData).toLower();
-        retVal = message.left(9) == QString("неисп.оу:");
-        if (retVal) {
-            m_rayNum = QString(message.at(15)).toInt();
-            m_kpuNum = QString(message.at(9)).toInt();
-        }
-    }
-    return retVal;
+    return Usk1IncomingDispatchKey{Usk1IncomingDispatchKey::correctPacket, 0, disconnectedKpuLeadBytes};
 }
 
-QString DisconnectedKpuUsk1IncomingCommand::description() const
+QString DisconnectedKpuUsk1IncomingCommand::description(const Usk1IncomingPacket &packet) const
 {
     return QObject::trUtf8("входящая команда: 'обнаружено отключение КПУ: луч %0, номер КПУ %1'")
-            .arg(m_rayNum)
-            .arg(m_kpuNum);
+            .arg(rayNum(packet))
+            .arg(kpuNum(packet));
 }
 
-void DisconnectedKpuUsk1IncomingCommand::informAboutCommand()
+void DisconnectedKpuUsk1IncomingCommand::informAboutCommand(SendUsk1Protocol *protocol, const Usk1IncomingPacket &packet) const
 {
-    if (m_protocol) {
-        m_protocol->onDetectedDisconnetcedKpu(m_rayNum, m_kpuNum);
+    if (protocol) {
+        protocol->onDetectedDisconnetcedKpu(rayNum(packet), kpuNum(packet));
     }
 }
 
+int DisconnectedKpuUsk1IncomingCommand::rayNum(const Usk1IncomingPacket &packet)
+{
+    return Usk1Win1251::digitValue(packet.data()[15]);
+}
 
-VoltageStatusChangedUsk1IncomingCommand::VoltageStatusChangedUsk1IncomingCommand(SendUsk1Protocol *protocol) :
-    Usk1IncomingCommand(protocol),
-    m_numOutput(0),
-    m_on(false)
+int DisconnectedKpuUsk1IncomingCommand::kpuNum(const Usk1IncomingPacket &packet)
 {
+    return Usk1Win1251::digitValue(packet.data()[9]);
+}
+
 
+bool VoltageStatusChangedUsk1IncomingCommand::isMyPacket(const Usk1IncomingPacket &packet) const
+{
+    int numOutput;
+    bool on;
+    return parseMessage(packet, numOutput, on);
 }
 
-bool VoltageStatusChangedUsk1IncomingCommand::isMyPacket(const QByteArray &packet)
+Usk1IncomingDispatchKey VoltageStatusChangedUsk1IncomingCommand::dispatchKey() const
 {
-    bool retVal = false;
-    if (parsePacket(packet)) {
-        QString message = getWin1251TextCodec()->toUnicode(m_packetData).toLower().trimmed();
-        QRegExp re("\\b(\\w+) 220-([12])\\b");
-        if (re.indexIn(message) >= 0)
-        {
-            retVal = true;
-            QString cap1 = re.cap(1);
-            QString cap2 = re.cap(2);
-            m_numOutput = cap2.toInt();
-            if (cap1 == QString("включение"))
-                m_on = true;
-            else if (cap1 == QString("выключение"))
-                m_on = false;
-            else
-                retVal = false;
-        }
-    }
-    return retVal;
+    // "включение 220-N" ищется в любом месте сообщения
+    return Usk1IncomingDispatchKey{Usk1IncomingDispatchKey::correctPacket, 0, nullptr};
 }
 
-QString VoltageStatusChangedUsk1IncomingCommand::description() const
+QString VoltageStatusChangedUsk1IncomingCommand::description(const Usk1IncomingPacket &packet) const
 {
+    int numOutput = 0;
+    bool on = false;
+    parseMessage(packet, numOutput, on);
     return QObject::trUtf8("входящая команда: '%2 НЧ выхода номер %1'")
-            .arg(m_numOutput)
-            .arg(m_on ? QObject::trUtf8("включение") : QObject::trUtf8("выключение"));
+            .arg(numOutput)
+            .arg(on ? QObject::trUtf8("включение") : QObject::trUtf8("выключение"));
 }
 
-void VoltageStatusChangedUsk1IncomingCommand::informAboutCommand()
+void VoltageStatusChangedUsk1IncomingCommand::informAboutCommand(SendUsk1Protocol *protocol, const Usk1IncomingPacket &packet) const
 {
-    if (m_protocol) {
-        m_protocol->onVoltageStatusChanged(m_numOutput, m_on);
+    int numOutput = 0;
+    bool on = false;
+    if (protocol && parseMessage(packet, numOutput, on)) {
+        protocol->onVoltageStatusChanged(numOutput, on);
     }
 }
 
-
-SensorChangeUsk1IncomingCommand::SensorChangeUsk1IncomingCommand(SendUsk1Protocol *protocol) :
-    Usk1IncomingCommand(protocol),
-    m_rayNum(0),
-    m_kpuNum(0),
-    m_sensorNum(0),
-    m_prevState(0),
-    m_curState(0)
+bool VoltageStatusChangedUsk1IncomingCommand::parseMessage(const Usk1IncomingPacket &packet, int &numOutput, bool &on)
 {
-
+    if (!packet.isCorrectPacket()) {
+        return false;
+    }
+    // эквивалент первого совпадения "\b(\w+) 220-([12])\b":
+    // ищем слово, за которым сразу идёт " 220-1" или " 220-2" и граница слова
+    const char *data = packet.data();
+    const int size = Usk1IncomingPacket::DataSize;
+    for (int begin = 0; begin < size; ++begin) {
+        if (!Usk1Win1251::isWordChar(data[begin])) {
+            continue;
+        }
+        int end = begin;
+        while (end < size && Usk1Win1251::isWordChar(data[end])) {
+            ++end;
+        }
+        const int outputPos = end + voltageOutputSignature.length;
+        if (Usk1Win1251::matchesAt(data, size, end, voltageOutputSignature) &&
+                outputPos < size && (data[outputPos] == '1' || data[outputPos] == '2') &&
+                (outputPos + 1 == size || !Usk1Win1251::isWordChar(data[outputPos + 1]))) {
+            numOutput = data[outputPos] - '0';
+            const int wordLength = end - begin;
+            if (wordLength == voltageOnSignature.length &&
+                    Usk1Win1251::matchesAt(data, end, begin, voltageOnSignature)) {
+                on = true;
+                return true;
+            }
+            if (wordLength == voltageOffSignature.length &&
+                    Usk1Win1251::matchesAt(data, end, begin, voltageOffSignature)) {
+                on = false;
+                return true;
+            }
+            return false;
+        }
+        begin = end;
+    }
+    return false;
 }
 
-bool SensorChangeUsk1IncomingCommand::isMyPacket(const QByteArray &packet)
+
+bool SensorChangeUsk1IncomingCommand::isMyPacket(const Usk1IncomingPacket &packet) const
 {
+    return packet.isCorrectPacket() &&
+            Usk1Win1251::matchesAt(packet.data(), Usk1IncomingPacket::DataSize, 0, sensorRaySignature) &&
+            Usk1Win1251::matchesAt(packet.data(), Usk1IncomingPacket::DataSize, 4, sensorKpuSignature);
+}
 
-    bool retVal = false;
-    if (parsePacket(packet)) {
-        QString message = getWin1251TextCodec()->toUnicode(m_packetData).toLower();
-        retVal = message.mid(0, 2) == "l=" && message.mid(4, 2) == "k=";
-        if (retVal) {
-            m_rayNum = QString(message.at(2)).toInt();
-            m_kpuNum = QString(message.at(6)).toInt();
-            m_prevState = m_u1;
-            m_curState = m_u2;
-        }
-    }
-    return retVal;
+Usk1IncomingDispatchKey SensorChangeUsk1IncomingCommand::dispatchKey() const
+{
+    return Usk1IncomingDispatchKey{Usk1IncomingDispatchKey::correctPacket, 0, sensorLeadBytes};
 }
 
-QString SensorChangeUsk1IncomingCommand::description() const
+QString SensorChangeUsk1IncomingCommand::description(const Usk1IncomingPacket &packet) const
 {
     QStringList values;
-    for (const QPair<int, int> &state : getChangedRelays()) {
+    for (const QPair<int, int> &state : getChangedRelays(packet)) {
         values.append(QString("%0:%1").arg(state.first).arg(state.second));
     }
     QString value = values.join(", ");
     return QObject::trUtf8("входящая команда: 'изменение датчиков на КПУ №%0 (луч #1): {%2}'")
-            .arg(m_kpuNum)
-            .arg(m_rayNum)
+            .arg(kpuNum(packet))
+            .arg(rayNum(packet))
             .arg(value);
 }
 
-void SensorChangeUsk1IncomingCommand::informAboutCommand()
+void SensorChangeUsk1IncomingCommand::informAboutCommand(SendUsk1Protocol *protocol, const Usk1IncomingPacket &packet) const
 {
-    if (m_protocol) {
-        for (const QPair<int, int> &state : getChangedRelays()) {
-            m_protocol->onSensorChanged(m_rayNum, m_kpuNum, state.first ,state.second);
+    if (protocol) {
+        const int ray = rayNum(packet);
+        const int kpu = kpuNum(packet);
+        for (const QPair<int, int> &state : getChangedRelays(packet)) {
+            protocol->onSensorChanged(ray, kpu, state.first ,state.second);
         }
     }
 }
 
-QList<QPair<int, int> > SensorChangeUsk1IncomingCommand::getChangedRelays() const
+int SensorChangeUsk1IncomingCommand::rayNum(const Usk1IncomingPacket &packet)
+{
+    return Usk1Win1251::digitValue(packet.data()[2]);
+}
+
+int SensorChangeUsk1IncomingCommand::kpuNum(const Usk1IncomingPacket &packet)
+{
+    return Usk1Win1251::digitValue(packet.data()[6]);
+}
+
+QList<QPair<int, int> > SensorChangeUsk1IncomingCommand::getChangedRelays(const Usk1IncomingPacket &packet)
 {
     QList<QPair<int, int> > retVal;
+    const char prevState = packet.u1();
+    const char curState = packet.u2();
     char bit = 0x01;
     // пробегаемся по всем контактам
     for (int i = 8; i != 0; --i)
     {
         // если предыдущее и текущее состояние различаеся - информируем внешний мир об этом
-        if ((m_prevState ^ m_curState) & bit) {
-            QPair<int, int> state(i, m_curState & bit ? 1 : 0);
+        if ((prevState ^ curState) & bit) {
+            QPair<int, int> state(i, curState & bit ? 1 : 0);
             retVal.append(state);
         }
         // переходим к сл. датчику (биту)
@@ -376,41 +555,42 @@ QList<QPair<int, int> > SensorChangeUsk1IncomingCommand::getChangedRelays() cons
 }
 
 
-QHash<QString, int> InfoUsk1IncomingCommand::m_uskInfoHash = QHash<QString, int>();
-
-InfoUsk1IncomingCommand::InfoUsk1IncomingCommand(SendUsk1Protocol *protocol) :
-    Usk1IncomingCommand(protocol)
+bool InfoUsk1IncomingCommand::isMyPacket(const Usk1IncomingPacket &packet) const
 {
-    if (m_uskInfoHash.isEmpty()) {
-        m_uskInfoHash[QString("включение уск")] = SendUSKv1Namespace::packetUskOn;
-        m_uskInfoHash[QString("установка часов")] = SendUSKv1Namespace::packetUskSettingTime;
-        m_uskInfoHash[QString("ошибка приема rs")] = SendUSKv1Namespace::packetUskErrorReceivingRS;
-    }
+    return infoPacket(packet) >= 0;
 }
 
-bool InfoUsk1IncomingCommand::isMyPacket(const QByteArray &packet)
+Usk1IncomingDispatchKey InfoUsk1IncomingCommand::dispatchKey() const
 {
-    bool retVal = false;
-    if (parsePacket(packet)) {
-        m_message = getWin1251TextCodec()->toUnicode(m_packetData).toLower().trimmed();
-        retVal = m_uskInfoHash.contains(m_message);
-    }
-    return retVal;
+    return Usk1IncomingDispatchKey{Usk1IncomingDispatchKey::correctPacket, 0, infoLeadBytes};
 }
 
-QString InfoUsk1IncomingCommand::description() const
+QString InfoUsk1IncomingCommand::description(const Usk1IncomingPacket &packet) const
 {
     QString retVal = QObject::trUtf8("");
-    if (m_uskInfoHash.contains(m_message)) {
+    if (infoPacket(packet) >= 0) {
         retVal = QObject::trUtf8("входящая комманда: %0")
-                .arg(m_message);
+                .arg(Usk1Win1251::toUnicode(packet.data(), Usk1IncomingPacket::DataSize).toLower().trimmed());
     }
     return retVal;
 }
 
-void InfoUsk1IncomingCommand::informAboutCommand()
+void InfoUsk1IncomingCommand::informAboutCommand(SendUsk1Protocol *protocol, const Usk1IncomingPacket &packet) const
 {
-    if (m_protocol && m_uskInfoHash.contains(m_message)) {
-        m_protocol->onUskInfoPacketReceived(m_uskInfoHash.value(m_message));
+    const int info = infoPacket(packet);
+    if (protocol && info >= 0) {
+        protocol->onUskInfoPacketReceived(info);
+    }
+}
+
+int InfoUsk1IncomingCommand::infoPacket(const Usk1IncomingPacket &packet)
+{
+    if (packet.isCorrectPacket()) {
+        for (const UskInfoSignature &info : uskInfoSignatures) {
+            if (Usk1Win1251::equalsTrimmed(packet.data(), Usk1IncomingPacket::DataSize, info.signature)) {
+                return info.infoPacket;
+            }
+        }
     }
+    return -1;
 }
@@ -2,153 +2,199 @@
 #define USK1INCOMINGCOMMAND_H
 
 #include <QObject>
-#include <QSharedPointer>
-#include <functional>
 #include <QList>
-#include <QMap>
-#include <QHash>
+#include <QVector>
 #include <QPair>
 
 class SendUsk1Protocol;
-class QTextCodec;
 
-class Usk1IncomingCommand
+// разобранный входящий пакет: контрольная сумма и поля извлекаются один раз,
+// сами данные не копируются (пакет должен жить, пока используется view)
+class Usk1IncomingPacket
 {
 public:
-    Usk1IncomingCommand(SendUsk1Protocol *protocol);
-    virtual ~Usk1IncomingCommand() {}
+    enum {
+        PacketSize = 26,
+        DataOffset = 7,
+        DataSize = 16
+    };
 
-    bool parsePacket(const QByteArray &packet);
-    virtual bool isMyPacket(const QByteArray &packet) = 0;
-    virtual QString description() const  = 0;
-    virtual void informAboutCommand() = 0;
+    Usk1IncomingPacket(const char *packet, const int length);
     bool isCorrectPacket() const;
-protected:
-    static QTextCodec *getWin1251TextCodec();
+    ushort uskNumber() const;
+    quint32 flags() const;
+    const char *data() const;
+    char u1() const;
+    char u2() const;
 
-protected:
-    SendUsk1Protocol *m_protocol;
+private:
+    const char *m_packet;
     quint32 m_flags;
     ushort m_uskNumber;
     bool m_isCorrectPacket;
-    QByteArray m_packetData;
-    char m_u1;
-    char m_u2;
 };
 
-typedef QSharedPointer<Usk1IncomingCommand> Usk1IncomingCommandSharedPtr;
-typedef std::function<Usk1IncomingCommandSharedPtr()> producedFunction;
+// предварительный отбор команд по пакету без вызова isMyPacket():
+// команда может подойти пакету, только если он подходит под её ключ
+struct Usk1IncomingDispatchKey
+{
+    enum PacketValidity {
+        anyPacket,
+        correctPacket,
+        incorrectPacket
+    };
+
+    PacketValidity validity;
+    // все эти биты флагов должны быть выставлены
+    quint32 requiredFlags;
+    // допустимые первые непробельные байты данных (CP1251), nullptr - любые
+    const char *leadBytes;
+};
+
+class Usk1IncomingCommand
+{
+public:
+    virtual ~Usk1IncomingCommand() {}
+
+    virtual bool isMyPacket(const Usk1IncomingPacket &packet) const = 0;
+    // по умолчанию команда проверяется для любого пакета
+    virtual Usk1IncomingDispatchKey dispatchKey() const;
+    virtual QString description(const Usk1IncomingPacket &packet) const  = 0;
+    virtual void informAboutCommand(SendUsk1Protocol *protocol, const Usk1IncomingPacket &packet) const = 0;
+};
 
 class Usk1IncomingCommandFactory {
 public:
-    Usk1IncomingCommandFactory(SendUsk1Protocol *protocol);
+    // фабрика со стандартными командами протокола
+    Usk1IncomingCommandFactory();
+    // пустая фабрика, дополняющая base своими командами (base должна её пережить
+    // и не меняться - её команды попадают в наборы кандидатов при регистрации)
+    explicit Usk1IncomingCommandFactory(const Usk1IncomingCommandFactory *base);
+    ~Usk1IncomingCommandFactory();
+    // общая для процесса фабрика стандартных команд, создаётся один раз
+    // при первом обращении (потокобезопасно) и дальше не меняется
+    static const Usk1IncomingCommandFactory &defaultFactory();
     template<typename A>
     void registerClass(const int priority) {
-        m_functions[priority].append([this]() {return Usk1IncomingCommandSharedPtr(new A(m_protocol));});
+        registerCommand(priority, new A());
     }
-    Usk1IncomingCommandSharedPtr getCommandByPacket(const QByteArray &packet);
+    // фабрика становится владельцем команды
+    void registerCommand(const int priority, Usk1IncomingCommand *command);
+    const Usk1IncomingCommand *getCommandByPacket(const Usk1IncomingPacket &packet) const;
 
 private:
-    SendUsk1Protocol *m_protocol;
-    QMap<int, QList<producedFunction> > m_functions;
+    Q_DISABLE_COPY(Usk1IncomingCommandFactory)
+
+    struct Entry {
+        int priority;
+        Usk1IncomingCommand *command;
+    };
+    struct Candidate {
+        quint32 requiredFlags;
+        const Usk1IncomingCommand *command;
+    };
+    void rebuildDispatch();
+    static uchar leadByte(const Usk1IncomingPacket &packet);
+
+    const Usk1IncomingCommandFactory *m_base;
+    // упорядочено по приоритету, внутри приоритета - по порядку регистрации
+    QVector<Entry> m_commands;
+    // кандидаты с учётом базовой фабрики в том же порядке: для корректных
+    // пакетов - по первому непробельному байту данных, для остальных - отдельно
+    QVector<Candidate> m_candidates[256];
+    QVector<Candidate> m_incorrectCandidates;
 };
 
 class UnknowUsk1IncomingCommand : public Usk1IncomingCommand {
 public:
-    UnknowUsk1IncomingCommand(SendUsk1Protocol *protocol);
-    bool isMyPacket(const QByteArray &packet);
-    QString description() const;
-    void informAboutCommand();
+    bool isMyPacket(const Usk1IncomingPacket &packet) const;
+    Usk1IncomingDispatchKey dispatchKey() const;
+    QString description(const Usk1IncomingPacket &packet) const;
+    void informAboutCommand(SendUsk1Protocol *protocol, const Usk1IncomingPacket &packet) const;
 };
 
 class BadUsk1IncomingCommand : public Usk1IncomingCommand {
 public:
-    BadUsk1IncomingCommand(SendUsk1Protocol *protocol);
-    bool isMyPacket(const QByteArray &packet);
-    QString description() const;
-    void informAboutCommand();
+    bool isMyPacket(const Usk1IncomingPacket &packet) const;
+    Usk1IncomingDispatchKey dispatchKey() const;
+    QString description(const Usk1IncomingPacket &packet) const;
+    void informAboutCommand(SendUsk1Protocol *protocol, const Usk1IncomingPacket &packet) const;
 };
 
 class ResetUsk1IncomingCommand : public Usk1IncomingCommand {
 public:
-    ResetUsk1IncomingCommand(SendUsk1Protocol *protocol);
-    bool isMyPacket(const QByteArray &packet);
-    QString description() const;
-    void informAboutCommand();
+    bool isMyPacket(const Usk1IncomingPacket &packet) const;
+    Usk1IncomingDispatchKey dispatchKey() const;
+    QString description(const Usk1IncomingPacket &packet) const;
+    void informAboutCommand(SendUsk1Protocol *protocol, const Usk1IncomingPacket &packet) const;
 };
 
 class TextMessageUsk1IncomingCommand : public Usk1IncomingCommand {
 public:
-    TextMessageUsk1IncomingCommand(SendUsk1Protocol *protocol);
-    bool isMyPacket(const QByteArray &packet);
-    QString description() const;
-    void informAboutCommand();
+    bool isMyPacket(const Usk1IncomingPacket &packet) const;
+    Usk1IncomingDispatchKey dispatchKey() const;
+    QString description(const Usk1IncomingPacket &packet) const;
+    void informAboutCommand(SendUsk1Protocol *protocol, const Usk1IncomingPacket &packet) const;
 };
 
 class NewKpuUsk1IncomingCommand : public Usk1IncomingCommand {
 public:
-    NewKpuUsk1IncomingCommand(SendUsk1Protocol *protocol);
-    bool isMyPacket(const QByteArray &packet);
-    QString description() const;
-    void informAboutCommand();
+    bool isMyPacket(const Usk1IncomingPacket &packet) const;
+    Usk1IncomingDispatchKey dispatchKey() const;
+    QString description(const Usk1IncomingPacket &packet) const;
+    void informAboutCommand(SendUsk1Protocol *protocol, const Usk1IncomingPacket &packet) const;
 
 private:
-    int m_kpuNum;
-    int m_rayNum;
+    static int rayNum(const Usk1IncomingPacket &packet);
+    static int kpuNum(const Usk1IncomingPacket &packet);
 };
 
 class DisconnectedKpuUsk1IncomingCommand : public Usk1IncomingCommand {
 public:
-    DisconnectedKpuUsk1IncomingCommand(SendUsk1Protocol *protocol);
-    bool isMyPacket(const QByteArray &packet);
-    QString description() const;
-    void informAboutCommand();
+    bool isMyPacket(const Usk1IncomingPacket &packet) const;
+    Usk1IncomingDispatchKey dispatchKey() const;
+    QString description(const Usk1IncomingPacket &packet) const;
+    void informAboutCommand(SendUsk1Protocol *protocol, const Usk1IncomingPacket &packet) const;
 
 private:
-    int m_kpuNum;
-    int m_rayNum;
+    static int rayNum(const Usk1IncomingPacket &packet);
+    static int kpuNum(const Usk1IncomingPacket &packet);
 };
 
 class VoltageStatusChangedUsk1IncomingCommand : public Usk1IncomingCommand {
 public:
-    VoltageStatusChangedUsk1IncomingCommand(SendUsk1Protocol *protocol);
-    bool isMyPacket(const QByteArray &packet);
-    QString description() const;
-    void informAboutCommand();
+    bool isMyPacket(const Usk1IncomingPacket &packet) const;
+    Usk1IncomingDispatchKey dispatchKey() const;
+    QString description(const Usk1IncomingPacket &packet) const;
+    void informAboutCommand(SendUsk1Protocol *protocol, const Usk1IncomingPacket &packet) const;
 
 private:
-    int m_numOutput;
-    bool m_on;
+    static bool parseMessage(const Usk1IncomingPacket &packet, int &numOutput, bool &on);
 };
 
 class SensorChangeUsk1IncomingCommand : public Usk1IncomingCommand {
 public:
-    SensorChangeUsk1IncomingCommand(SendUsk1Protocol *protocol);
-    bool isMyPacket(const QByteArray &packet);
-    QString description() const;
-    void informAboutCommand();
-
-private:
-    QList<QPair<int, int> > getChangedRelays() const;
+    bool isMyPacket(const Usk1IncomingPacket &packet) const;
+    Usk1IncomingDispatchKey dispatchKey() const;
+    QString description(const Usk1IncomingPacket &packet) const;
+    void informAboutCommand(SendUsk1Protocol *protocol, const Usk1IncomingPacket &packet) const;
 
 private:
-    int m_rayNum;
-    int m_kpuNum;
-    int m_sensorNum;
-    char m_prevState;
-    char m_curState;
+    static int rayNum(const Usk1IncomingPacket &packet);
+    static int kpuNum(const Usk1IncomingPacket &packet);
+    static QList<QPair<int, int> > getChangedRelays(const Usk1IncomingPacket &packet);
 };
 
 class InfoUsk1IncomingCommand : public Usk1IncomingCommand {
 public:
-    InfoUsk1IncomingCommand(SendUsk1Protocol *protocol);
-    bool isMyPacket(const QByteArray &packet);
-    QString description() const;
-    void informAboutCommand();
+    bool isMyPacket(const Usk1IncomingPacket &packet) const;
+    Usk1IncomingDispatchKey dispatchKey() const;
+    QString description(const Usk1IncomingPacket &packet) const;
+    void informAboutCommand(SendUsk1Protocol *protocol, const Usk1IncomingPacket &packet) const;
 
 private:
-    static QHash<QString, int> m_uskInfoHash;
-    QString m_message;
+    // -1, если пакет не информационный
+    static int infoPacket(const Usk1IncomingPacket &packet);
 };
 
 #endif // USK1INCOMINGCOMMAND_H
@@ -0,0 +1,406 @@
+#include "usk1nativeserialport.h"
+
+#include <QCoreApplication>
+#include <QEvent>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
+#include <QThread>
+#include <QDebug>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+
+// событий готовности, забираемых за один вызов epoll_wait
+#define maxEventsPerWait 64
+
+namespace {
+
+const QEvent::Type readyEventType = static_cast<QEvent::Type>(QEvent::registerEventType());
+
+// готовность порта, переданная потоком ввода-вывода в поток порта
+class Usk1SerialReadyEvent : public QEvent
+{
+public:
+    explicit Usk1SerialReadyEvent(const quint32 events) :
+        QEvent(readyEventType),
+        m_events(events)
+    {
+    }
+
+    quint32 events() const
+    {
+        return m_events;
+    }
+
+private:
+    quint32 m_events;
+};
+
+speed_t speedForBaudRate(const int baudRate)
+{
+    switch (baudRate) {
+    case 1200: return B1200;
+    case 2400: return B2400;
+    case 4800: return B4800;
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    default: return B0;
+    }
+}
+
+} // namespace
+
+// один поток на процесс: ждёт готовности всех открытых портов на одном epoll
+// и пересылает её порту в его поток. Порт взводится однократно (EPOLLONESHOT)
+// и перевзводится сам, дочитав данные, - на пачку байт приходится одно
+// пробуждение рабочего потока
+class Usk1SerialIoThread : public QThread
+{
+public:
+    Usk1SerialIoThread();
+    ~Usk1SerialIoThread();
+
+    bool addPort(Usk1NativeSerialPort *port, const int fd);
+    void armPort(Usk1NativeSerialPort *port, const int fd, const bool wantWrite);
+    void removePort(Usk1NativeSerialPort *port, const int fd);
+
+protected:
+    void run() override;
+
+private:
+    int m_epollFd;
+    // событие остановки потока
+    int m_wakeFd;
+    // порт удаляется из множества под замком - событие уже закрытому порту не уйдёт
+    QMutex m_mutex;
+    QSet<Usk1NativeSerialPort *> m_ports;
+};
+
+Q_GLOBAL_STATIC(Usk1SerialIoThread, serialIoThread)
+
+Usk1SerialIoThread::Usk1SerialIoThread() :
+    m_epollFd(epoll_create1(EPOLL_CLOEXEC)),
+    m_wakeFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+{
+    setObjectName("Usk1SerialIoThread");
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    if (m_epollFd < 0 || m_wakeFd < 0 || epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &event) != 0) {
+        qWarning() << Q_FUNC_INFO << "can't create epoll instance:" << qt_error_string(errno);
+        return;
+    }
+    start(QThread::TimeCriticalPriority);
+}
+
+Usk1SerialIoThread::~Usk1SerialIoThread()
+{
+    if (isRunning()) {
+        const quint64 value = 1;
+        if (::write(m_wakeFd, &value, sizeof(value)) == sizeof(value)) {
+            wait();
+        }
+    }
+    if (m_wakeFd >= 0) {
+        ::close(m_wakeFd);
+    }
+    if (m_epollFd >= 0) {
+        ::close(m_epollFd);
+    }
+}
+
+bool Usk1SerialIoThread::addPort(Usk1NativeSerialPort *port, const int fd)
+{
+    if (!isRunning()) {
+        return false;
+    }
+    QMutexLocker locker(&m_mutex);
+    epoll_event event;
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.ptr = port;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        return false;
+    }
+    m_ports.insert(port);
+    return true;
+}
+
+void Usk1SerialIoThread::armPort(Usk1NativeSerialPort *port, const int fd, const bool wantWrite)
+{
+    epoll_event event;
+    event.events = EPOLLIN | EPOLLONESHOT | (wantWrite ? static_cast<quint32>(EPOLLOUT) : 0u);
+    event.data.ptr = port;
+    epoll_ctl(m_epollFd, EPOLL_CTL_MOD, fd, &event);
+}
+
+void Usk1SerialIoThread::removePort(Usk1NativeSerialPort *port, const int fd)
+{
+    QMutexLocker locker(&m_mutex);
+    m_ports.remove(port);
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void Usk1SerialIoThread::run()
+{
+    epoll_event events[maxEventsPerWait];
+    forever {
+        const int count = epoll_wait(m_epollFd, events, maxEventsPerWait, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            qWarning() << Q_FUNC_INFO << "epoll_wait failed:" << qt_error_string(errno);
+            return;
+        }
+        QMutexLocker locker(&m_mutex);
+        for (int i = 0; i < count; ++i) {
+            Usk1NativeSerialPort *port = static_cast<Usk1NativeSerialPort *>(events[i].data.ptr);
+            if (!port) {
+                return;
+            }
+            if (m_ports.contains(port)) {
+                QCoreApplication::postEvent(port, new Usk1SerialReadyEvent(events[i].events));
+            }
+        }
+    }
+}
+
+Usk1NativeSerialPort::Usk1NativeSerialPort(const QString &portName, QObject *parent) :
+    QIODevice(parent),
+    m_portName(portName),
+    m_baudRate(9600),
+    m_fd(-1),
+    m_failed(false)
+{
+}
+
+Usk1NativeSerialPort::~Usk1NativeSerialPort()
+{
+    close();
+}
+
+QString Usk1NativeSerialPort::portName() const
+{
+    return m_portName;
+}
+
+void Usk1NativeSerialPort::setBaudRate(const int baudRate)
+{
+    m_baudRate = baudRate;
+    if (m_fd >= 0) {
+        configure();
+    }
+}
+
+bool Usk1NativeSerialPort::open(OpenMode mode)
+{
+    if (isOpen()) {
+        return false;
+    }
+    // имя как у QSerialPort: "ttyS0" или полный путь
+    const QString path = m_portName.startsWith('/') ? m_portName : "/dev/" + m_portName;
+    m_fd = ::open(QFile::encodeName(path).constData(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (m_fd < 0) {
+        setErrorString(qt_error_string(errno));
+        return false;
+    }
+    m_failed = false;
+    m_pendingWrite.clear();
+    if (!configure()) {
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    // свой буфер QIODevice не нужен: read() читает прямо из драйвера в буфер получателя
+    QIODevice::open(mode | Unbuffered);
+    if (!serialIoThread()->addPort(this, m_fd)) {
+        setErrorString(tr("Can't register port in the I/O thread"));
+        ::close(m_fd);
+        m_fd = -1;
+        QIODevice::close();
+        return false;
+    }
+    return true;
+}
+
+void Usk1NativeSerialPort::close()
+{
+    if (m_fd >= 0) {
+        if (!serialIoThread.isDestroyed()) {
+            serialIoThread()->removePort(this, m_fd);
+        }
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_pendingWrite.clear();
+    if (isOpen()) {
+        QIODevice::close();
+    }
+}
+
+bool Usk1NativeSerialPort::isSequential() const
+{
+    return true;
+}
+
+qint64 Usk1NativeSerialPort::bytesAvailable() const
+{
+    int available = 0;
+    if (m_fd >= 0 && ioctl(m_fd, FIONREAD, &available) != 0) {
+        available = 0;
+    }
+    return available + QIODevice::bytesAvailable();
+}
+
+qint64 Usk1NativeSerialPort::bytesToWrite() const
+{
+    return m_pendingWrite.size();
+}
+
+qint64 Usk1NativeSerialPort::readData(char *data, qint64 maxSize)
+{
+    if (m_fd < 0) {
+        return -1;
+    }
+    const ssize_t res = ::read(m_fd, data, static_cast<size_t>(maxSize));
+    if (res >= 0) {
+        return res;
+    }
+    if (errno == EAGAIN || errno == EINTR) {
+        return 0;
+    }
+    fail(QSerialPort::ReadError, qt_error_string(errno));
+    return -1;
+}
+
+qint64 Usk1NativeSerialPort::writeData(const char *data, qint64 maxSize)
+{
+    if (m_fd < 0 || m_failed) {
+        return -1;
+    }
+    qint64 written = 0;
+    // хвост предыдущей записи уходит первым - порядок байт сохраняется
+    if (m_pendingWrite.isEmpty()) {
+        const ssize_t res = ::write(m_fd, data, static_cast<size_t>(maxSize));
+        if (res < 0 && errno != EAGAIN && errno != EINTR) {
+            fail(QSerialPort::WriteError, qt_error_string(errno));
+            return -1;
+        }
+        written = qMax<qint64>(res, 0);
+    }
+    if (written > 0) {
+        // как у QSerialPort - о записи сообщается из цикла событий, а не изнутри write()
+        QMetaObject::invokeMethod(this, "bytesWritten", Qt::QueuedConnection, Q_ARG(qint64, written));
+    }
+    if (written < maxSize) {
+        m_pendingWrite.append(data + written, static_cast<int>(maxSize - written));
+        arm();
+    }
+    return maxSize;
+}
+
+bool Usk1NativeSerialPort::event(QEvent *e)
+{
+    if (e->type() != readyEventType) {
+        return QIODevice::event(e);
+    }
+    if (m_fd < 0) {
+        return true;
+    }
+    const quint32 events = static_cast<Usk1SerialReadyEvent *>(e)->events();
+    if ((events & EPOLLOUT) && !m_pendingWrite.isEmpty()) {
+        flushPendingWrite();
+    }
+    // повторное или запоздавшее уведомление без данных получателю не передаём
+    if ((events & (EPOLLIN | EPOLLERR | EPOLLHUP)) && bytesAvailable() > 0) {
+        emit readyRead();
+    }
+    if ((events & (EPOLLERR | EPOLLHUP)) && m_fd >= 0) {
+        // устройство отключено: остаток дочитан, готовность больше не ждём
+        fail(QSerialPort::ResourceError, tr("Serial port hang up"));
+    }
+    arm();
+    return true;
+}
+
+bool Usk1NativeSerialPort::configure()
+{
+    const speed_t speed = speedForBaudRate(m_baudRate);
+    if (speed == B0) {
+        setErrorString(tr("Unsupported baud rate %0").arg(m_baudRate));
+        return false;
+    }
+    // монопольный доступ, как у QSerialPort
+    if (ioctl(m_fd, TIOCEXCL) != 0) {
+        setErrorString(qt_error_string(errno));
+        return false;
+    }
+    termios tio;
+    if (tcgetattr(m_fd, &tio) != 0) {
+        setErrorString(qt_error_string(errno));
+        return false;
+    }
+    // 8N1 без управления потоком и без обработки символов;
+    // VMIN = VTIME = 0: read() не ждёт, о наличии данных сообщает epoll
+    cfmakeraw(&tio);
+    tio.c_cflag &= ~(CSIZE | CSTOPB | PARENB | CRTSCTS);
+    tio.c_cflag |= CS8 | CLOCAL | CREAD;
+    tio.c_iflag &= ~(IXON | IXOFF | IXANY);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if (cfsetispeed(&tio, speed) != 0 || cfsetospeed(&tio, speed) != 0 ||
+            tcsetattr(m_fd, TCSANOW, &tio) != 0) {
+        setErrorString(qt_error_string(errno));
+        return false;
+    }
+    tcflush(m_fd, TCIOFLUSH);
+    // без задержки драйвера перед передачей принятого (для 8250 и части USB-адаптеров;
+    // где не поддерживается - не ошибка)
+    serial_struct serial;
+    if (ioctl(m_fd, TIOCGSERIAL, &serial) == 0) {
+        serial.flags |= ASYNC_LOW_LATENCY;
+        ioctl(m_fd, TIOCSSERIAL, &serial);
+    }
+    return true;
+}
+
+void Usk1NativeSerialPort::flushPendingWrite()
+{
+    const ssize_t res = ::write(m_fd, m_pendingWrite.constData(), static_cast<size_t>(m_pendingWrite.size()));
+    if (res > 0) {
+        m_pendingWrite.remove(0, static_cast<int>(res));
+        emit bytesWritten(res);
+    } else if (res < 0 && errno != EAGAIN && errno != EINTR) {
+        fail(QSerialPort::WriteError, qt_error_string(errno));
+    }
+}
+
+void Usk1NativeSerialPort::arm()
+{
+    if (m_fd >= 0 && !m_failed && !serialIoThread.isDestroyed()) {
+        serialIoThread()->armPort(this, m_fd, !m_pendingWrite.isEmpty());
+    }
+}
+
+void Usk1NativeSerialPort::fail(const QSerialPort::SerialPortError error, const QString &errorString)
+{
+    setErrorString(errorString);
+    // об отказе сообщается один раз
+    if (m_failed) {
+        return;
+    }
+    m_failed = true;
+    emit errorOccurred(error);
+}
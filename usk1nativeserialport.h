@@ -0,0 +1,57 @@
+#ifndef USK1NATIVESERIALPORT_H
+#define USK1NATIVESERIALPORT_H
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QSerialPort>
+
+// последовательный порт Linux без QSerialPort: tty открывается и настраивается
+// через termios напрямую, готовность всех портов процесса ждёт один поток
+// ввода-вывода на одном epoll, а чтение идёт простым read() прямо в буфер
+// получателя - без промежуточного буфера и уведомителя на каждый порт в цикле
+// событий рабочего потока. Наружу - тот же интерфейс QIODevice (readyRead,
+// bytesWritten, read, write) и сигнал errorOccurred, что и у QSerialPort
+class Usk1NativeSerialPort : public QIODevice
+{
+    Q_OBJECT
+public:
+    explicit Usk1NativeSerialPort(const QString &portName, QObject *parent = 0);
+    ~Usk1NativeSerialPort();
+
+    QString portName() const;
+    // открытый порт перенастраивается сразу; поддерживаются стандартные скорости termios
+    void setBaudRate(const int baudRate);
+
+    bool open(OpenMode mode) override;
+    void close() override;
+    bool isSequential() const override;
+    qint64 bytesAvailable() const override;
+    qint64 bytesToWrite() const override;
+
+signals:
+    // порт отказал (устройство отключено, ошибка чтения или записи); как у
+    // QSerialPort, после отказа порт нужно закрыть
+    void errorOccurred(QSerialPort::SerialPortError error);
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+    bool event(QEvent *e) override;
+
+private:
+    bool configure();
+    void flushPendingWrite();
+    void arm();
+    void fail(const QSerialPort::SerialPortError error, const QString &errorString);
+
+private:
+    QString m_portName;
+    int m_baudRate;
+    int m_fd;
+    // порт отказал (устройство отключено) - готовность больше не запрашивается
+    bool m_failed;
+    // хвост записи, не принятый драйвером сразу; дописывается по готовности порта
+    QByteArray m_pendingWrite;
+};
+
+#endif // USK1NATIVESERIALPORT_H
@@ -1,12 +1,26 @@
 #include "usk1outgoingcommand.h"
-#include <QSerialPort>
-#include <QTextCodec>
-
-Usk1OutgoingCommand::Usk1OutgoingCommand(QSerialPort *serialPort, const int &uskNum, const int attempts) :
+#include "usk1outgoingcommandpool.h"
+#include "usk1timesyncscheduler.h"
+#include "usk1win1251.h"
+#include "senduskv1global.h"
+#include <QIODevice>
+#include <cstring>
+
+// "КПУ ", "Вкл 0 " и "Выкл 0" в CP1251
+static const char relayTextPrefix[] = "\xca\xcf\xd3 ";
+static const char relayTextOn[] = "\xc2\xea\xeb 0 ";
+static const char relayTextOff[] = "\xc2\xfb\xea\xeb 0";
+
+Usk1OutgoingCommand::Usk1OutgoingCommand(QIODevice *serialPort, const int &uskNum, const int attempts) :
     m_serialPort(serialPort),
     m_attempts(attempts),
     m_isFirstAttempt(true),
-    m_uskNumber(uskNum)
+    m_uskNumber(uskNum),
+    m_priority(SendUSKv1Namespace::priorityLow),
+    m_enqueueTime(0),
+    m_lifetime(-1),
+    m_deadline(0),
+    m_frameEncoded(false)
 {
 }
 
@@ -14,6 +28,47 @@ Usk1OutgoingCommand::~Usk1OutgoingCommand()
 {
 }
 
+void *Usk1OutgoingCommand::operator new(size_t size)
+{
+    return Usk1OutgoingCommandPool::allocate(size, nullptr);
+}
+
+void *Usk1OutgoingCommand::operator new(size_t size, Usk1OutgoingCommandPool &pool)
+{
+    return Usk1OutgoingCommandPool::allocate(size, &pool);
+}
+
+void Usk1OutgoingCommand::operator delete(void *ptr)
+{
+    Usk1OutgoingCommandPool::release(ptr);
+}
+
+void Usk1OutgoingCommand::operator delete(void *ptr, Usk1OutgoingCommandPool &pool)
+{
+    Q_UNUSED(pool)
+    Usk1OutgoingCommandPool::release(ptr);
+}
+
+quint64 Usk1OutgoingCommand::coalescingKey() const
+{
+    return 0;
+}
+
+int Usk1OutgoingCommand::targetState() const
+{
+    return -1;
+}
+
+quint64 Usk1OutgoingCommand::makeCoalescingKey(const int commandType, const quint32 target)
+{
+    return (static_cast<quint64>(commandType + 1) << 32) | target;
+}
+
+int Usk1OutgoingCommand::memoryFootprint() const
+{
+    return sizeof(Usk1OutgoingCommand);
+}
+
 bool Usk1OutgoingCommand::needToWaitCommand() const
 {
     return false;
@@ -39,8 +94,35 @@ void Usk1OutgoingCommand::sendCommand()
     m_isFirstAttempt = false;
     if (m_serialPort && m_serialPort->isOpen()) {
         --m_attempts;
-        m_serialPort->write(outgoingBinaryPacket());
+        const Frame &packet = frame();
+        m_serialPort->write(reinterpret_cast<const char *>(packet.data()), FrameSize);
+    }
+}
+
+const Usk1OutgoingCommand::Frame &Usk1OutgoingCommand::frame()
+{
+    if (!m_frameEncoded || !isFrameCacheable()) {
+        encodeFrame(m_frame);
+        m_frameEncoded = true;
     }
+    return m_frame;
+}
+
+QByteArray Usk1OutgoingCommand::outgoingBinaryPacket() const
+{
+    Frame packet;
+    encodeFrame(packet);
+    return QByteArray(reinterpret_cast<const char *>(packet.data()), FrameSize);
+}
+
+bool Usk1OutgoingCommand::isFrameCacheable() const
+{
+    return true;
+}
+
+void Usk1OutgoingCommand::setSerialPort(QIODevice *serialPort)
+{
+    m_serialPort = serialPort;
 }
 
 int Usk1OutgoingCommand::uskNumber() const
@@ -48,21 +130,74 @@ int Usk1OutgoingCommand::uskNumber() const
     return m_uskNumber;
 }
 
-QTextCodec *Usk1OutgoingCommand::getWin1251TextCodec()
+void Usk1OutgoingCommand::setPriority(const quint8 priority)
+{
+    // байт приоритета входит в кадр: в закодированном меняем его
+    // и на ту же разность - аддитивную контрольную сумму
+    if (priority != m_priority && m_frameEncoded) {
+        m_frame[PriorityOffset] = priority;
+        m_frame[FrameSize - 1] += static_cast<quint8>(priority - m_priority);
+    }
+    m_priority = priority;
+}
+
+void Usk1OutgoingCommand::setEncodedFrame(const Frame &frame)
 {
-    static QTextCodec *codecWin1251 = QTextCodec::codecForName("Windows-1251");
-    return codecWin1251;
+    m_frame = frame;
+    m_frameEncoded = true;
 }
 
+quint8 Usk1OutgoingCommand::priority() const
+{
+    return m_priority;
+}
 
-SendTimeUsk1OutgoingCommand::SendTimeUsk1OutgoingCommand(QSerialPort *serialPort,
+void Usk1OutgoingCommand::setEnqueueTime(const qint64 msec)
+{
+    m_enqueueTime = msec;
+}
+
+qint64 Usk1OutgoingCommand::enqueueTime() const
+{
+    return m_enqueueTime;
+}
+
+void Usk1OutgoingCommand::setLifetime(const qint64 msec)
+{
+    m_lifetime = qMax<qint64>(-1, msec);
+}
+
+qint64 Usk1OutgoingCommand::lifetime() const
+{
+    return m_lifetime;
+}
+
+void Usk1OutgoingCommand::setDeadline(const qint64 msec)
+{
+    m_deadline = msec;
+}
+
+qint64 Usk1OutgoingCommand::deadline() const
+{
+    return m_deadline;
+}
+
+bool Usk1OutgoingCommand::isExpired(const qint64 now) const
+{
+    return m_deadline > 0 && now > m_deadline;
+}
+
+
+SendTimeUsk1OutgoingCommand::SendTimeUsk1OutgoingCommand(QIODevice *serialPort,
                                                          const int &uskNum,
                                                          const int attempts,
                                                          const QDateTime &dateTime) :
     Usk1OutgoingCommand(serialPort, uskNum, attempts),
-    m_dateTime(dateTime)
+    m_dateTime(dateTime),
+    m_epochMsecs(dateTime.toMSecsSinceEpoch()),
+    m_offsetFromUtc(dateTime.offsetFromUtc())
 {
-
+    m_age.start();
 }
 
 QString SendTimeUsk1OutgoingCommand::description() const
@@ -71,24 +206,40 @@ QString SendTimeUsk1OutgoingCommand::description() const
             .arg(m_dateTime.toString());
 }
 
-QByteArray SendTimeUsk1OutgoingCommand::outgoingBinaryPacket() const
+void SendTimeUsk1OutgoingCommand::encodeFrame(Frame &frame) const
+{
+    encodeHeader(frame, 2);
+    // текст времени общий для всех УСК в пределах секунды - от кадра к кадру
+    // меняются только адрес, приоритет и контрольная сумма
+    const qint64 epochMsecs = m_epochMsecs + m_age.elapsed();
+    const qint64 epochSecond = epochMsecs >= 0 ? epochMsecs / 1000 : (epochMsecs - 999) / 1000;
+    const Usk1TimeSyncScheduler::TimeText &text =
+            Usk1TimeSyncScheduler::forCurrentThread()->timeText(epochSecond, m_offsetFromUtc);
+    memcpy(frame.data() + TextOffset, text.bytes, TextSize);
+    frame[TextOffset + TextSize] = 0x00;
+    frame[TextOffset + TextSize + 1] = 0x00;
+    encodeCrc(frame);
+}
+
+bool SendTimeUsk1OutgoingCommand::isFrameCacheable() const
+{
+    // в каждой попытке - время её отправки
+    return false;
+}
+
+int SendTimeUsk1OutgoingCommand::commandType() const
+{
+    return SendUSKv1Namespace::commandSendTime;
+}
+
+int SendTimeUsk1OutgoingCommand::memoryFootprint() const
+{
+    return sizeof(SendTimeUsk1OutgoingCommand);
+}
+
+quint64 SendTimeUsk1OutgoingCommand::coalescingKey() const
 {
-    QByteArray res;
-    res.append(getFirstPartOfPacket(2, 0));
-    QString day = QString("%0").arg(m_dateTime.date().day(), 2, 10, QChar('0'));
-    QString month = QString("%0").arg(m_dateTime.date().month(), 2, 10, QChar('0'));
-    QString year = QString::number(m_dateTime.date().year() % 10);
-    QString hour = QString("%0").arg(m_dateTime.time().hour(), 2, 10, QChar('0'));
-    QString minute = QString("%0").arg(m_dateTime.time().minute(), 2, 10, QChar('0'));
-    QString second = QString("%0").arg(m_dateTime.time().second(), 2, 10, QChar('0'));
-    QString stringDate;
-    stringDate.append(day).append('/').append(month).append('/').append(year).append(' ')
-            .append(hour).append(':').append(minute).append(':').append(second);
-    res.append(stringDate);
-    res.append(static_cast<char>(0x00));
-    res.append(static_cast<char>(0x00));
-    appendCrcToPacket(res);
-    return res;
+    return makeCoalescingKey(commandType(), 0);
 }
 
 bool SendTimeUsk1OutgoingCommand::needToInformAboutStartSending() const
@@ -96,31 +247,29 @@ bool SendTimeUsk1OutgoingCommand::needToInformAboutStartSending() const
     return false;
 }
 
-QByteArray Usk1OutgoingCommand::getFirstPartOfPacket(const quint64 &flags, const quint8 &priority) const
+void Usk1OutgoingCommand::encodeHeader(Frame &frame, const quint32 flags) const
 {
-    QByteArray res;
     const ushort uskNum = uskNumber();
-    res.append(static_cast<char>(0x00));
-    res.append(uskNum & 0xff);
-    res.append((uskNum >> 8) & 0xff);
-    res.append(flags & 0xff);
-    res.append((flags >> 8) & 0xff);
-    res.append((flags >> 16) & 0xff);
-    res.append((flags >> 24) & 0xff);
-    res.append(priority);
-    return res;
+    frame[0] = 0x00;
+    frame[1] = uskNum & 0xff;
+    frame[2] = (uskNum >> 8) & 0xff;
+    frame[3] = flags & 0xff;
+    frame[4] = (flags >> 8) & 0xff;
+    frame[5] = (flags >> 16) & 0xff;
+    frame[6] = (flags >> 24) & 0xff;
+    frame[PriorityOffset] = m_priority;
 }
 
-void Usk1OutgoingCommand::appendCrcToPacket(QByteArray &packet) const
+void Usk1OutgoingCommand::encodeCrc(Frame &frame)
 {
-    char crc = 0x00;
-    for (int i = 0; i < packet.length(); ++i)
-        crc += packet.at(i);
-    packet.append(crc);
+    quint8 crc = 0x00;
+    for (int i = 0; i < FrameSize - 1; ++i)
+        crc += frame[i];
+    frame[FrameSize - 1] = crc;
 }
 
 
-SendMessageUsk1OutgoingCommand::SendMessageUsk1OutgoingCommand(QSerialPort *serialPort,
+SendMessageUsk1OutgoingCommand::SendMessageUsk1OutgoingCommand(QIODevice *serialPort,
                                                                const int &uskNum,
                                                                const int attempts,
                                                                const QString &message) :
@@ -136,23 +285,29 @@ QString SendMessageUsk1OutgoingCommand::description() const
             .arg(m_message);
 }
 
-QByteArray SendMessageUsk1OutgoingCommand::outgoingBinaryPacket() const
+void SendMessageUsk1OutgoingCommand::encodeFrame(Frame &frame) const
 {
-    QByteArray res;
-    res.append(getFirstPartOfPacket(0x00000004, 0));
-    QByteArray cp1251Message;
-    cp1251Message.resize(16);
-    cp1251Message.fill(' ');
-    cp1251Message.replace(0, m_message.length() > 16 ? 16 : m_message.length(), getWin1251TextCodec()->fromUnicode(m_message.left(16)));
-    res.append(cp1251Message);
-    res.append(static_cast<char>(0x00));
-    res.append(static_cast<char>(0x00));
-    appendCrcToPacket(res);
-    return res;
+    encodeHeader(frame, 0x00000004);
+    char *text = reinterpret_cast<char *>(frame.data() + TextOffset);
+    memset(text, ' ', TextSize);
+    Usk1Win1251::fromUnicode(m_message, text, TextSize);
+    frame[TextOffset + TextSize] = 0x00;
+    frame[TextOffset + TextSize + 1] = 0x00;
+    encodeCrc(frame);
 }
 
+int SendMessageUsk1OutgoingCommand::commandType() const
+{
+    return SendUSKv1Namespace::commandSendMessage;
+}
 
-ResetUsk1OutgoingCommand::ResetUsk1OutgoingCommand(QSerialPort *serialPort, const int &uskNum, const int attempts) :
+int SendMessageUsk1OutgoingCommand::memoryFootprint() const
+{
+    return sizeof(SendMessageUsk1OutgoingCommand) + m_message.capacity() * static_cast<int>(sizeof(QChar));
+}
+
+
+ResetUsk1OutgoingCommand::ResetUsk1OutgoingCommand(QIODevice *serialPort, const int &uskNum, const int attempts) :
     Usk1OutgoingCommand(serialPort, uskNum, attempts)
 {
 
@@ -163,16 +318,16 @@ QString ResetUsk1OutgoingCommand::description() const
     return QObject::trUtf8("команда сброса УСК");
 }
 
-QByteArray ResetUsk1OutgoingCommand::outgoingBinaryPacket() const
+void ResetUsk1OutgoingCommand::encodeFrame(Frame &frame) const
 {
-    QByteArray res;
-    res.resize(26);
-    res.fill(static_cast<char>(0x00));
-    res[1] = static_cast<char>(uskNumber() & 0xff);
-    res[2] = static_cast<char>((uskNumber() >> 8) & 0xff);
-    res[3] = 0x01;
-    appendCrcToPacket(res);
-    return res;
+    frame.fill(0x00);
+    encodeHeader(frame, 0x00000001);
+    encodeCrc(frame);
+}
+
+int ResetUsk1OutgoingCommand::commandType() const
+{
+    return SendUSKv1Namespace::commandReset;
 }
 
 bool ResetUsk1OutgoingCommand::needToWaitCommand() const
@@ -181,7 +336,7 @@ bool ResetUsk1OutgoingCommand::needToWaitCommand() const
 }
 
 
-ChangeRelayUsk1OutgoingCommand::ChangeRelayUsk1OutgoingCommand(QSerialPort *serialPort, const int &uskNum,
+ChangeRelayUsk1OutgoingCommand::ChangeRelayUsk1OutgoingCommand(QIODevice *serialPort, const int &uskNum,
                                                                const int attempts, const int &rayNum,
                                                                const int &kpuNum, const int &sensorNum,
                                                                const int &relayStatus, const QString &sensorName) :
@@ -202,25 +357,73 @@ QString ChangeRelayUsk1OutgoingCommand::description() const
             .arg(m_relayStatus == 0 ? QObject::trUtf8("0") : QObject::trUtf8("1"));
 }
 
-QByteArray ChangeRelayUsk1OutgoingCommand::outgoingBinaryPacket() const
+void ChangeRelayUsk1OutgoingCommand::encodeFrame(Frame &frame) const
+{
+    encodeHeader(frame, 0x00001000);
+    // "КПУ л/к/д/Вкл 0 " или "КПУ л/к/д/Выкл 0" сразу в CP1251
+    char *text = reinterpret_cast<char *>(frame.data() + TextOffset);
+    memset(text, ' ', TextSize);
+    int pos = putText(text, 0, relayTextPrefix);
+    pos = putDigit(text, pos, m_rayNum % 10);
+    pos = putText(text, pos, "/");
+    pos = putDigit(text, pos, m_kpuNum % 10);
+    pos = putText(text, pos, "/");
+    pos = putDigit(text, pos, m_sensorNum % 10);
+    pos = putText(text, pos, "/");
+    putText(text, pos, m_relayStatus == 1 ? relayTextOn : relayTextOff);
+    frame[TextOffset + TextSize] = static_cast<quint8>(m_rayNum);
+    frame[TextOffset + TextSize + 1] = static_cast<quint8>(m_kpuNum * 0x10 + ((m_sensorNum - 1) << 1) + m_relayStatus);
+    encodeCrc(frame);
+}
+
+int ChangeRelayUsk1OutgoingCommand::putText(char *text, int pos, const char *value)
+{
+    while (*value && pos < TextSize) {
+        text[pos++] = *value++;
+    }
+    return pos;
+}
+
+int ChangeRelayUsk1OutgoingCommand::putDigit(char *text, int pos, const int value)
+{
+    // остаток от деления отрицательного номера тоже отрицательный
+    if (value < 0 && pos < TextSize) {
+        text[pos++] = '-';
+    }
+    if (pos < TextSize) {
+        text[pos++] = static_cast<char>('0' + (value < 0 ? -value : value));
+    }
+    return pos;
+}
+
+int ChangeRelayUsk1OutgoingCommand::commandType() const
+{
+    return SendUSKv1Namespace::commandChangeRelay;
+}
+
+int ChangeRelayUsk1OutgoingCommand::memoryFootprint() const
+{
+    return sizeof(ChangeRelayUsk1OutgoingCommand) + m_sensorName.capacity() * static_cast<int>(sizeof(QChar));
+}
+
+quint64 ChangeRelayUsk1OutgoingCommand::coalescingKey() const
+{
+    return targetKey(m_rayNum, m_kpuNum, m_sensorNum);
+}
+
+int ChangeRelayUsk1OutgoingCommand::targetState() const
 {
-    QByteArray res;
-    res.append(getFirstPartOfPacket(0x00001000, 0));
-    QString textCommand = QObject::trUtf8("КПУ %0/%1/%2/%3")
-            .arg(m_rayNum % 10)
-            .arg(m_kpuNum % 10)
-            .arg(m_sensorNum % 10)
-            .arg(m_relayStatus == 1 ? QObject::trUtf8("Вкл 0 ") : QObject::trUtf8("Выкл 0"));
-    QByteArray encodedCommand = getWin1251TextCodec()->fromUnicode(textCommand);
-    res.append(encodedCommand);
-    res.append(static_cast<char>(m_rayNum));
-    res.append(static_cast<char>(m_kpuNum * 0x10 + ((m_sensorNum - 1) << 1) + m_relayStatus));
-    appendCrcToPacket(res);
-    return res;
+    return m_relayStatus == 1 ? 1 : 0;
+}
+
+quint64 ChangeRelayUsk1OutgoingCommand::targetKey(const int rayNum, const int kpuNum, const int sensorNum)
+{
+    return makeCoalescingKey(SendUSKv1Namespace::commandChangeRelay,
+                             ((rayNum & 0xff) << 16) | ((kpuNum & 0xff) << 8) | (sensorNum & 0xff));
 }
 
 
-ChangeVoltageUsk1OutgoingCommand::ChangeVoltageUsk1OutgoingCommand(QSerialPort *serialPort, const int &uskNum,
+ChangeVoltageUsk1OutgoingCommand::ChangeVoltageUsk1OutgoingCommand(QIODevice *serialPort, const int &uskNum,
                                                                    const int attempts, const int numOutput, const bool &on) :
     Usk1OutgoingCommand(serialPort, uskNum, attempts),
     m_numOutput(numOutput),
@@ -229,6 +432,17 @@ ChangeVoltageUsk1OutgoingCommand::ChangeVoltageUsk1OutgoingCommand(QSerialPort *
 
 }
 
+ChangeVoltageUsk1OutgoingCommand::ChangeVoltageUsk1OutgoingCommand(QIODevice *serialPort, const int &uskNum,
+                                                                   const int attempts, const int numOutput, const bool &on,
+                                                                   const Usk1VoltageFrames &frames) :
+    Usk1OutgoingCommand(serialPort, uskNum, attempts),
+    m_numOutput(numOutput),
+    m_on(on)
+{
+    // заготовки - с низшим приоритетом, как и новая команда
+    setEncodedFrame(frames.frame(numOutput, on));
+}
+
 QString ChangeVoltageUsk1OutgoingCommand::description() const
 {
     return   QObject::trUtf8("команда %2 НЧ выхода номер %1")
@@ -236,9 +450,9 @@ QString ChangeVoltageUsk1OutgoingCommand::description() const
             .arg(m_on ? QObject::trUtf8("включения") : QObject::trUtf8("выключения"));
 }
 
-QByteArray ChangeVoltageUsk1OutgoingCommand::outgoingBinaryPacket() const
+void ChangeVoltageUsk1OutgoingCommand::encodeFrame(Frame &frame) const
 {
-    quint64 flag;
+    quint32 flag;
     switch (m_numOutput) {
     case 2:
         flag = m_on ? 0x00002000 : 0x00004000;
@@ -247,10 +461,60 @@ QByteArray ChangeVoltageUsk1OutgoingCommand::outgoingBinaryPacket() const
         flag = m_on ? 0x00000020 : 0x00000100;
         break;
     }
-    QByteArray res = getFirstPartOfPacket(flag, 0);
-    res.append("                ");
-    res.append((char)0x00);
-    res.append((char)0x00);
-    appendCrcToPacket(res);
-    return res;
+    encodeHeader(frame, flag);
+    memset(frame.data() + TextOffset, ' ', TextSize);
+    frame[TextOffset + TextSize] = 0x00;
+    frame[TextOffset + TextSize + 1] = 0x00;
+    encodeCrc(frame);
+}
+
+int ChangeVoltageUsk1OutgoingCommand::commandType() const
+{
+    return SendUSKv1Namespace::commandChangeVoltage;
+}
+
+int ChangeVoltageUsk1OutgoingCommand::memoryFootprint() const
+{
+    return sizeof(ChangeVoltageUsk1OutgoingCommand);
+}
+
+quint64 ChangeVoltageUsk1OutgoingCommand::coalescingKey() const
+{
+    return targetKey(m_numOutput);
+}
+
+int ChangeVoltageUsk1OutgoingCommand::targetState() const
+{
+    return m_on ? 1 : 0;
+}
+
+quint64 ChangeVoltageUsk1OutgoingCommand::targetKey(const int numOutput)
+{
+    return makeCoalescingKey(SendUSKv1Namespace::commandChangeVoltage, static_cast<quint32>(numOutput));
+}
+
+Usk1VoltageFrames::Usk1VoltageFrames()
+{
+    setUskNum(0);
+}
+
+void Usk1VoltageFrames::setUskNum(const int uskNum)
+{
+    for (const bool on : {false, true}) {
+        // выход 2 кодируется своими флагами, остальные - общими
+        for (const int numOutput : {1, 2}) {
+            ChangeVoltageUsk1OutgoingCommand command(nullptr, uskNum, 0, numOutput, on);
+            command.encodeFrame(m_frames[index(numOutput, on)]);
+        }
+    }
+}
+
+const Usk1OutgoingCommand::Frame &Usk1VoltageFrames::frame(const int numOutput, const bool on) const
+{
+    return m_frames[index(numOutput, on)];
+}
+
+int Usk1VoltageFrames::index(const int numOutput, const bool on)
+{
+    return (numOutput == 2 ? 2 : 0) + (on ? 1 : 0);
 }
@@ -1,64 +1,126 @@
 #ifndef USK1OUTGOINGCOMMAND_H
 #define USK1OUTGOINGCOMMAND_H
 
-#include <QSharedPointer>
+#include <QSharedData>
 #include <QDateTime>
+#include <QElapsedTimer>
 #include <QList>
+#include <array>
 
-class QSerialPort;
+class QIODevice;
+class Usk1OutgoingCommandPool;
+class Usk1VoltageFrames;
 
-class Usk1OutgoingCommand
+// счётчик ссылок встроен в команду (без отдельного блока управления),
+// память под команду берётся из пула УСК: new (pool) Команда(...)
+class Usk1OutgoingCommand : public QSharedData
 {
 public:
-    Usk1OutgoingCommand(QSerialPort *serialPort, const int &uskNum,  const int attempts);
+    enum {
+        FrameSize = 27,
+        PriorityOffset = 7,
+        TextOffset = 8,
+        TextSize = 16
+    };
+    typedef std::array<quint8, FrameSize> Frame;
+
+    Usk1OutgoingCommand(QIODevice *serialPort, const int &uskNum,  const int attempts);
     virtual ~Usk1OutgoingCommand();
+    static void *operator new(size_t size);
+    static void *operator new(size_t size, Usk1OutgoingCommandPool &pool);
+    static void operator delete(void *ptr);
+    static void operator delete(void *ptr, Usk1OutgoingCommandPool &pool);
     virtual QString description() const = 0;
-    virtual QByteArray outgoingBinaryPacket() const = 0;
+    QByteArray outgoingBinaryPacket() const;
+    virtual int commandType() const = 0;
+    // команды с одинаковым ненулевым ключом управляют одной целью,
+    // в очереди достаточно последней из них
+    virtual quint64 coalescingKey() const;
+    // состояние цели после выполнения команды (-1 - команда не задаёт состояние)
+    virtual int targetState() const;
+    // приблизительный объём памяти, занимаемый командой в очереди, байт
+    virtual int memoryFootprint() const;
     virtual bool needToWaitCommand() const;
     virtual bool needToInformAboutStartSending() const;
     bool isAnotherAttemptPresent() const;
     bool isFirstAttempt() const;
     void sendCommand();
+    void setSerialPort(QIODevice *serialPort);
     int uskNumber() const;
+    void setPriority(const quint8 priority);
+    quint8 priority() const;
+    void setEnqueueTime(const qint64 msec);
+    qint64 enqueueTime() const;
+    // срок жизни команды в очереди, мс: -1 - по умолчанию для типа, 0 - бессрочно
+    void setLifetime(const qint64 msec);
+    qint64 lifetime() const;
+    // момент по часам очереди, после которого команда не отправляется (0 - бессрочно)
+    void setDeadline(const qint64 msec);
+    qint64 deadline() const;
+    bool isExpired(const qint64 now) const;
+    // заполняет кадр целиком, без выделения памяти
+    virtual void encodeFrame(Frame &frame) const = 0;
+    // false - кадр зависит от момента отправки и кодируется на каждую попытку
+    virtual bool isFrameCacheable() const;
+    // кадр для передачи: кодируется при первой отправке и повторяется во всех попытках
+    const Frame &frame();
 
 protected:
-    static QTextCodec *getWin1251TextCodec();
-    QByteArray getFirstPartOfPacket(const quint64 &flags,
-                                    const quint8 &priority = 0x00) const;
-    void appendCrcToPacket(QByteArray &packet) const;
+    static quint64 makeCoalescingKey(const int commandType, const quint32 target);
+    // заголовок: номер УСК, флаги и байт приоритета
+    void encodeHeader(Frame &frame, const quint32 flags) const;
+    static void encodeCrc(Frame &frame);
+    // готовый кадр с текущим приоритетом команды - кодировать не нужно
+    void setEncodedFrame(const Frame &frame);
 
 private:
-    QSerialPort *m_serialPort;
+    QIODevice *m_serialPort;
     int m_attempts;
     bool m_isFirstAttempt;
     int m_uskNumber;
+    quint8 m_priority;
+    qint64 m_enqueueTime;
+    qint64 m_lifetime;
+    qint64 m_deadline;
+    Frame m_frame;
+    bool m_frameEncoded;
 };
 
-typedef QSharedPointer<Usk1OutgoingCommand> Usk1OutgoingCommandSharedPtr;
+typedef QExplicitlySharedDataPointer<Usk1OutgoingCommand> Usk1OutgoingCommandSharedPtr;
 typedef QList<Usk1OutgoingCommandSharedPtr> Usk1OutgoingCommandSharedPtrList;
 
 class SendTimeUsk1OutgoingCommand : public Usk1OutgoingCommand
 {
 public:
-    SendTimeUsk1OutgoingCommand(QSerialPort *serialPort, const int &uskNum,
+    SendTimeUsk1OutgoingCommand(QIODevice *serialPort, const int &uskNum,
                                 const int attempts,
                                 const QDateTime &dateTime);
     virtual QString description() const;
-    virtual QByteArray outgoingBinaryPacket() const;
+    virtual void encodeFrame(Frame &frame) const;
+    virtual bool isFrameCacheable() const;
+    virtual int commandType() const;
+    virtual int memoryFootprint() const;
+    virtual quint64 coalescingKey() const;
     bool needToInformAboutStartSending() const;
 
 private:
     QDateTime m_dateTime;
+    // время в пакете отсчитывается от момента отправки, а не постановки в очередь
+    QElapsedTimer m_age;
+    qint64 m_epochMsecs;
+    int m_offsetFromUtc;
 };
 
 class SendMessageUsk1OutgoingCommand : public Usk1OutgoingCommand
 {
 public:
-    SendMessageUsk1OutgoingCommand(QSerialPort *serialPort, const int &uskNum,
+    SendMessageUsk1OutgoingCommand(QIODevice *serialPort, const int &uskNum,
                                 const int attempts,
                                 const QString &message);
     virtual QString description() const;
-    virtual QByteArray outgoingBinaryPacket() const;
+    virtual void encodeFrame(Frame &frame) const;
+    virtual int commandType() const;
+    virtual int memoryFootprint() const;
 
 private:
     QString m_message;
@@ -67,22 +129,33 @@ private:
 class ResetUsk1OutgoingCommand : public Usk1OutgoingCommand
 {
 public:
-    ResetUsk1OutgoingCommand(QSerialPort *serialPort, const int &uskNum,
+    ResetUsk1OutgoingCommand(QIODevice *serialPort, const int &uskNum,
                              const int attempts);
     virtual QString description() const;
-    virtual QByteArray outgoingBinaryPacket() const;
+    virtual void encodeFrame(Frame &frame) const;
+    virtual int commandType() const;
     virtual bool needToWaitCommand() const;
 };
 
 class ChangeRelayUsk1OutgoingCommand : public Usk1OutgoingCommand
 {
 public:
-    ChangeRelayUsk1OutgoingCommand(QSerialPort *serialPort, const int &uskNum,
+    ChangeRelayUsk1OutgoingCommand(QIODevice *serialPort, const int &uskNum,
                                    const int attempts, const int &rayNum,
                                    const int &kpuNum, const int &sensorNum,
                                    const int &relayStatus, const QString &sensorName);
     virtual QString description() const;
-    virtual QByteArray outgoingBinaryPacket() const;
+    virtual void encodeFrame(Frame &frame) const;
+    virtual int commandType() const;
+    virtual int memoryFootprint() const;
+    virtual quint64 coalescingKey() const;
+    virtual int targetState() const;
+    static quint64 targetKey(const int rayNum, const int kpuNum, const int sensorNum);
+
+private:
+    // запись в текстовое поле кадра с обрезкой по его размеру; возвращают новую позицию
+    static int putText(char *text, int pos, const char *value);
+    static int putDigit(char *text, int pos, const int value);
 
 private:
     int m_rayNum;
@@ -95,16 +168,41 @@ private:
 class ChangeVoltageUsk1OutgoingCommand : public Usk1OutgoingCommand
 {
 public:
-    ChangeVoltageUsk1OutgoingCommand(QSerialPort *serialPort, const int &uskNum,
+    ChangeVoltageUsk1OutgoingCommand(QIODevice *serialPort, const int &uskNum,
                              const int attempts,
                              const int numOutput, const bool &on);
+    // кадр копируется из заранее закодированных для этого УСК
+    ChangeVoltageUsk1OutgoingCommand(QIODevice *serialPort, const int &uskNum,
+                             const int attempts,
+                             const int numOutput, const bool &on,
+                             const Usk1VoltageFrames &frames);
     virtual QString description() const;
-    virtual QByteArray outgoingBinaryPacket() const;
+    virtual void encodeFrame(Frame &frame) const;
+    virtual int commandType() const;
+    virtual int memoryFootprint() const;
+    virtual quint64 coalescingKey() const;
+    virtual int targetState() const;
+    static quint64 targetKey(const int numOutput);
 
 private:
     int m_numOutput;
     bool m_on;
 };
 
+// кадры включения и выключения НЧ выходов одного УСК (выход 2 и остальные)
+// с низшим приоритетом: кодируются при смене номера УСК, а не на каждую команду
+class Usk1VoltageFrames
+{
+public:
+    Usk1VoltageFrames();
+    void setUskNum(const int uskNum);
+    const Usk1OutgoingCommand::Frame &frame(const int numOutput, const bool on) const;
+
+private:
+    static int index(const int numOutput, const bool on);
+
+    Usk1OutgoingCommand::Frame m_frames[4];
+};
+
 
 #endif // USK1OUTGOINGCOMMAND_H
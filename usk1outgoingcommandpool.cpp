@@ -0,0 +1,129 @@
+#include "usk1outgoingcommandpool.h"
+#include "usk1outgoingcommand.h"
+
+#include <new>
+
+template<typename T>
+static Q_DECL_CONSTEXPR size_t maxCommandSize()
+{
+    return sizeof(T);
+}
+
+template<typename T, typename U, typename... Rest>
+static Q_DECL_CONSTEXPR size_t maxCommandSize()
+{
+    return sizeof(T) > maxCommandSize<U, Rest...>() ? sizeof(T) : maxCommandSize<U, Rest...>();
+}
+
+static Q_DECL_CONSTEXPR size_t roundUp(const size_t size, const size_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+// запись вмещает любую из команд протокола
+static const size_t recordPayload = roundUp(maxCommandSize<SendTimeUsk1OutgoingCommand,
+                                                            SendMessageUsk1OutgoingCommand,
+                                                            ResetUsk1OutgoingCommand,
+                                                            ChangeRelayUsk1OutgoingCommand,
+                                                            ChangeVoltageUsk1OutgoingCommand>(),
+                                            alignof(std::max_align_t));
+
+Usk1OutgoingCommandPool::Arena::Arena() :
+    freeList(nullptr),
+    capacity(0),
+    inUse(0),
+    orphaned(false)
+{
+}
+
+Usk1OutgoingCommandPool::Arena::~Arena()
+{
+    for (char *slab : slabs) {
+        ::operator delete(slab);
+    }
+}
+
+Usk1OutgoingCommandPool::Usk1OutgoingCommandPool() :
+    m_arena(new Arena),
+    m_heapAllocations(0)
+{
+}
+
+Usk1OutgoingCommandPool::~Usk1OutgoingCommandPool()
+{
+    if (m_arena->inUse > 0) {
+        // команды ещё живы - арену освободит последняя из них
+        m_arena->orphaned = true;
+        return;
+    }
+    delete m_arena;
+}
+
+void *Usk1OutgoingCommandPool::allocate(const size_t size, Usk1OutgoingCommandPool *pool)
+{
+    Block *block = nullptr;
+    if (pool && size <= recordPayload) {
+        Arena *arena = pool->m_arena;
+        if (!arena->freeList) {
+            pool->grow();
+        }
+        block = arena->freeList;
+        arena->freeList = block->nextFree;
+        ++arena->inUse;
+    } else {
+        if (pool) {
+            ++pool->m_heapAllocations;
+        }
+        block = static_cast<Block *>(::operator new(sizeof(Block) + size));
+        block->arena = nullptr;
+    }
+    return block + 1;
+}
+
+void Usk1OutgoingCommandPool::release(void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    Block *block = static_cast<Block *>(ptr) - 1;
+    Arena *arena = block->arena;
+    if (!arena) {
+        ::operator delete(block);
+        return;
+    }
+    block->nextFree = arena->freeList;
+    arena->freeList = block;
+    if (--arena->inUse == 0 && arena->orphaned) {
+        delete arena;
+    }
+}
+
+int Usk1OutgoingCommandPool::capacity() const
+{
+    return m_arena->capacity;
+}
+
+int Usk1OutgoingCommandPool::inUse() const
+{
+    return m_arena->inUse;
+}
+
+quint64 Usk1OutgoingCommandPool::heapAllocations() const
+{
+    return m_heapAllocations;
+}
+
+void Usk1OutgoingCommandPool::grow()
+{
+    const size_t recordSize = sizeof(Block) + recordPayload;
+    char *slab = static_cast<char *>(::operator new(recordSize * RecordsPerSlab));
+    ++m_heapAllocations;
+    m_arena->slabs.append(slab);
+    for (int i = RecordsPerSlab - 1; i >= 0; --i) {
+        Block *block = reinterpret_cast<Block *>(slab + i * recordSize);
+        block->arena = m_arena;
+        block->nextFree = m_arena->freeList;
+        m_arena->freeList = block;
+    }
+    m_arena->capacity += RecordsPerSlab;
+}
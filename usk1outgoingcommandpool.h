@@ -0,0 +1,64 @@
+#ifndef USK1OUTGOINGCOMMANDPOOL_H
+#define USK1OUTGOINGCOMMANDPOOL_H
+
+#include <QtGlobal>
+#include <QVector>
+#include <cstddef>
+
+// пул записей фиксированного размера под исходящие команды одного УСК:
+// память берётся у системы пачками и после освобождения команды
+// возвращается в пул, а не в кучу; пул не потокобезопасен. Если при
+// удалении пула команды ещё живы, пачки освобождает последняя из них
+class Usk1OutgoingCommandPool
+{
+public:
+    enum {
+        RecordsPerSlab = 32
+    };
+
+    Usk1OutgoingCommandPool();
+    ~Usk1OutgoingCommandPool();
+
+    // блок под объект размером size; без пула или для объекта крупнее записи -
+    // из общей кучи (освобождается тем же release)
+    static void *allocate(const size_t size, Usk1OutgoingCommandPool *pool);
+    static void release(void *ptr);
+
+    // записей всего и занятых
+    int capacity() const;
+    int inUse() const;
+    // обращения к общей куче: пачки записей и команды, не поместившиеся в запись
+    quint64 heapAllocations() const;
+
+private:
+    Q_DISABLE_COPY(Usk1OutgoingCommandPool)
+
+    struct Block;
+
+    // пачки записей живут отдельно от пула, чтобы пережить его,
+    // пока на записи ссылаются команды
+    struct Arena {
+        Arena();
+        ~Arena();
+
+        QVector<char *> slabs;
+        Block *freeList;
+        int capacity;
+        int inUse;
+        bool orphaned;  // пул удалён, арена ждёт освобождения последней записи
+    };
+
+    // заголовок перед каждой командой: из какой арены блок (nullptr - из кучи)
+    struct alignas(std::max_align_t) Block {
+        Arena *arena;
+        Block *nextFree;
+    };
+
+    void grow();
+
+private:
+    Arena *m_arena;
+    quint64 m_heapAllocations;
+};
+
+#endif // USK1OUTGOINGCOMMANDPOOL_H
@@ -0,0 +1,334 @@
+#include "usk1outgoingqueue.h"
+
+using namespace SendUSKv1Namespace;
+
+#define defaultAgingInterval 10000
+// команды исполнительным устройствам после долгой паузы опаснее, чем их потеря
+#define defaultActuatorLifetime 30000
+#define defaultMessageLifetime 300000
+// несколько минут недоступности УСК при обычной нагрузке
+#define defaultMaxCommands 256
+#define defaultMaxBytes (64 * 1024)
+
+QAtomicInt Usk1OutgoingQueue::m_globalCommands(0);
+QAtomicInt Usk1OutgoingQueue::m_globalBytes(0);
+QAtomicInt Usk1OutgoingQueue::m_globalMaxCommands(0);
+QAtomicInt Usk1OutgoingQueue::m_globalMaxBytes(0);
+
+Usk1OutgoingQueue::Usk1OutgoingQueue() :
+    m_agingInterval(defaultAgingInterval),
+    m_count(0),
+    m_bytes(0),
+    m_maxCommands(defaultMaxCommands),
+    m_maxBytes(defaultMaxBytes),
+    m_overflowPolicy(overflowDropLowestPriority)
+{
+    for (int &typeCount : m_typeCounts) {
+        typeCount = 0;
+    }
+    // исполнительные команды вытесняют служебный трафик
+    m_priorities[commandSendTime] = priorityLow;
+    m_priorities[commandSendMessage] = priorityNormal;
+    m_priorities[commandReset] = priorityNormal;
+    m_priorities[commandChangeRelay] = priorityHigh;
+    m_priorities[commandChangeVoltage] = priorityHigh;
+    // время собирается в момент отправки и устаревшим не бывает
+    m_lifetimes[commandSendTime] = 0;
+    m_lifetimes[commandSendMessage] = defaultMessageLifetime;
+    m_lifetimes[commandReset] = defaultActuatorLifetime;
+    m_lifetimes[commandChangeRelay] = defaultActuatorLifetime;
+    m_lifetimes[commandChangeVoltage] = defaultActuatorLifetime;
+}
+
+Usk1OutgoingQueue::~Usk1OutgoingQueue()
+{
+    clear();
+}
+
+void Usk1OutgoingQueue::setPriority(const int commandType, const int priority)
+{
+    if (commandType >= 0 && commandType < commandTypesCount &&
+            priority >= 0 && priority < prioritiesCount) {
+        m_priorities[commandType] = priority;
+    }
+}
+
+int Usk1OutgoingQueue::priority(const int commandType) const
+{
+    if (commandType >= 0 && commandType < commandTypesCount) {
+        return m_priorities[commandType];
+    }
+    return priorityNormal;
+}
+
+void Usk1OutgoingQueue::setAgingInterval(const qint64 msec)
+{
+    m_agingInterval = qMax<qint64>(0, msec);
+}
+
+void Usk1OutgoingQueue::setLifetime(const int commandType, const qint64 msec)
+{
+    if (commandType >= 0 && commandType < commandTypesCount) {
+        m_lifetimes[commandType] = qMax<qint64>(0, msec);
+    }
+}
+
+qint64 Usk1OutgoingQueue::lifetime(const int commandType) const
+{
+    if (commandType >= 0 && commandType < commandTypesCount) {
+        return m_lifetimes[commandType];
+    }
+    return 0;
+}
+
+void Usk1OutgoingQueue::setLimits(const int maxCommands, const int maxBytes)
+{
+    m_maxCommands = qMax(0, maxCommands);
+    m_maxBytes = qMax(0, maxBytes);
+}
+
+int Usk1OutgoingQueue::maxCommands() const
+{
+    return m_maxCommands;
+}
+
+int Usk1OutgoingQueue::maxBytes() const
+{
+    return m_maxBytes;
+}
+
+void Usk1OutgoingQueue::setOverflowPolicy(const int policy)
+{
+    if (policy == overflowRejectNew || policy == overflowDropOldest ||
+            policy == overflowDropLowestPriority) {
+        m_overflowPolicy = policy;
+    }
+}
+
+int Usk1OutgoingQueue::overflowPolicy() const
+{
+    return m_overflowPolicy;
+}
+
+void Usk1OutgoingQueue::setGlobalLimits(const int maxCommands, const int maxBytes)
+{
+    m_globalMaxCommands.store(qMax(0, maxCommands));
+    m_globalMaxBytes.store(qMax(0, maxBytes));
+}
+
+int Usk1OutgoingQueue::globalCommands()
+{
+    return m_globalCommands.load();
+}
+
+int Usk1OutgoingQueue::globalBytes()
+{
+    return m_globalBytes.load();
+}
+
+bool Usk1OutgoingQueue::enqueue(const Usk1OutgoingCommandSharedPtr &command, const qint64 now,
+                                Usk1OutgoingCommandSharedPtrList *coalesced,
+                                Usk1OutgoingCommandSharedPtrList *dropped)
+{
+    if (!command) {
+        return false;
+    }
+    const int commandPriority = priority(command->commandType());
+    command->setPriority(static_cast<quint8>(commandPriority));
+    command->setEnqueueTime(now);
+    const qint64 commandLifetime = command->lifetime() < 0 ? lifetime(command->commandType()) : command->lifetime();
+    command->setDeadline(commandLifetime > 0 ? now + commandLifetime : 0);
+    const quint64 key = command->coalescingKey();
+    if (key != 0) {
+        for (int queue = 0; queue < prioritiesCount; ++queue) {
+            for (int i = 0; i < m_queues[queue].count(); ++i) {
+                if (m_queues[queue].at(i)->coalescingKey() == key) {
+                    // сохраняем место в очереди и возраст заменённой команды;
+                    // число команд не растёт, ограничения не проверяются
+                    command->setEnqueueTime(m_queues[queue].at(i)->enqueueTime());
+                    const Usk1OutgoingCommandSharedPtr superseded = takeAt(queue, i);
+                    if (coalesced) {
+                        coalesced->append(superseded);
+                    }
+                    insert(commandPriority, queue == commandPriority ? i : m_queues[commandPriority].count(), command);
+                    return true;
+                }
+            }
+        }
+    }
+    const int commandBytes = command->memoryFootprint();
+    if (!fits(commandBytes)) {
+        // вытесняем, только если после этого новая команда точно поместится
+        int freedCommands = 0;
+        int freedBytes = 0;
+        for (int queue = 0; queue < prioritiesCount; ++queue) {
+            if (m_overflowPolicy == overflowRejectNew ||
+                    (m_overflowPolicy == overflowDropLowestPriority && queue > commandPriority)) {
+                break;
+            }
+            for (const Usk1OutgoingCommandSharedPtr &queued : m_queues[queue]) {
+                ++freedCommands;
+                freedBytes += queued->memoryFootprint();
+            }
+        }
+        if (!fits(commandBytes, freedCommands, freedBytes)) {
+            return false;
+        }
+        while (!fits(commandBytes)) {
+            const int queue = victimQueue(commandPriority);
+            if (queue < 0) {
+                // общий лимит тем временем заняли очереди других потоков
+                return false;
+            }
+            const Usk1OutgoingCommandSharedPtr victim = takeAt(queue, 0);
+            if (dropped) {
+                dropped->append(victim);
+            }
+        }
+    }
+    insert(commandPriority, m_queues[commandPriority].count(), command);
+    return true;
+}
+
+Usk1OutgoingCommandSharedPtr Usk1OutgoingQueue::dequeue(const qint64 now)
+{
+    // сравниваем только головы очередей: в каждой из них самая старая команда класса
+    int bestQueue = -1;
+    int bestPriority = -1;
+    for (int i = prioritiesCount - 1; i >= 0; --i) {
+        if (m_queues[i].isEmpty()) {
+            continue;
+        }
+        const Usk1OutgoingCommandSharedPtr &head = m_queues[i].first();
+        const int headPriority = effectivePriority(head, now);
+        if (headPriority > bestPriority ||
+                (headPriority == bestPriority &&
+                 head->enqueueTime() < m_queues[bestQueue].first()->enqueueTime())) {
+            bestQueue = i;
+            bestPriority = headPriority;
+        }
+    }
+    if (bestQueue < 0) {
+        return Usk1OutgoingCommandSharedPtr(nullptr);
+    }
+    return takeAt(bestQueue, 0);
+}
+
+Usk1OutgoingCommandSharedPtr Usk1OutgoingQueue::take(const quint64 coalescingKey)
+{
+    if (coalescingKey != 0) {
+        for (int queue = 0; queue < prioritiesCount; ++queue) {
+            for (int i = 0; i < m_queues[queue].count(); ++i) {
+                if (m_queues[queue].at(i)->coalescingKey() == coalescingKey) {
+                    return takeAt(queue, i);
+                }
+            }
+        }
+    }
+    return Usk1OutgoingCommandSharedPtr(nullptr);
+}
+
+bool Usk1OutgoingQueue::isEmpty() const
+{
+    return m_count == 0;
+}
+
+int Usk1OutgoingQueue::count() const
+{
+    return m_count;
+}
+
+int Usk1OutgoingQueue::bytes() const
+{
+    return m_bytes;
+}
+
+int Usk1OutgoingQueue::countOfType(const int commandType) const
+{
+    if (commandType < 0 || commandType >= commandTypesCount) {
+        return 0;
+    }
+    return m_typeCounts[commandType];
+}
+
+void Usk1OutgoingQueue::clear()
+{
+    for (Usk1OutgoingCommandSharedPtrList &queue : m_queues) {
+        queue.clear();
+    }
+    m_globalCommands.fetchAndAddRelaxed(-m_count);
+    m_globalBytes.fetchAndAddRelaxed(-m_bytes);
+    for (int &typeCount : m_typeCounts) {
+        typeCount = 0;
+    }
+    m_count = 0;
+    m_bytes = 0;
+}
+
+int Usk1OutgoingQueue::effectivePriority(const Usk1OutgoingCommandSharedPtr &command, const qint64 now) const
+{
+    int retVal = command->priority();
+    if (m_agingInterval > 0) {
+        retVal += static_cast<int>((now - command->enqueueTime()) / m_agingInterval);
+    }
+    return qMin<int>(retVal, prioritiesCount - 1);
+}
+
+bool Usk1OutgoingQueue::fits(const int commandBytes, const int freedCommands, const int freedBytes) const
+{
+    const int globalMaxCommands = m_globalMaxCommands.load();
+    const int globalMaxBytes = m_globalMaxBytes.load();
+    return (m_maxCommands == 0 || m_count - freedCommands + 1 <= m_maxCommands) &&
+            (m_maxBytes == 0 || m_bytes - freedBytes + commandBytes <= m_maxBytes) &&
+            (globalMaxCommands == 0 || m_globalCommands.load() - freedCommands + 1 <= globalMaxCommands) &&
+            (globalMaxBytes == 0 || m_globalBytes.load() - freedBytes + commandBytes <= globalMaxBytes);
+}
+
+int Usk1OutgoingQueue::victimQueue(const int commandPriority) const
+{
+    int retVal = -1;
+    switch (m_overflowPolicy) {
+    case overflowDropOldest:
+        for (int queue = 0; queue < prioritiesCount; ++queue) {
+            if (!m_queues[queue].isEmpty() &&
+                    (retVal < 0 || m_queues[queue].first()->enqueueTime() < m_queues[retVal].first()->enqueueTime())) {
+                retVal = queue;
+            }
+        }
+        break;
+    case overflowDropLowestPriority:
+        for (int queue = 0; queue <= commandPriority; ++queue) {
+            if (!m_queues[queue].isEmpty()) {
+                retVal = queue;
+                break;
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    return retVal;
+}
+
+void Usk1OutgoingQueue::insert(const int queue, const int index, const Usk1OutgoingCommandSharedPtr &command)
+{
+    const int commandBytes = command->memoryFootprint();
+    m_queues[queue].insert(index, command);
+    ++m_typeCounts[command->commandType()];
+    ++m_count;
+    m_bytes += commandBytes;
+    m_globalCommands.fetchAndAddRelaxed(1);
+    m_globalBytes.fetchAndAddRelaxed(commandBytes);
+}
+
+Usk1OutgoingCommandSharedPtr Usk1OutgoingQueue::takeAt(const int queue, const int index)
+{
+    const Usk1OutgoingCommandSharedPtr command = m_queues[queue].takeAt(index);
+    const int commandBytes = command->memoryFootprint();
+    --m_typeCounts[command->commandType()];
+    --m_count;
+    m_bytes -= commandBytes;
+    m_globalCommands.fetchAndAddRelaxed(-1);
+    m_globalBytes.fetchAndAddRelaxed(-commandBytes);
+    return command;
+}
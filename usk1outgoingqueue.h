@@ -0,0 +1,80 @@
+#ifndef USK1OUTGOINGQUEUE_H
+#define USK1OUTGOINGQUEUE_H
+
+#include <QAtomicInt>
+
+#include "usk1outgoingcommand.h"
+#include "senduskv1global.h"
+
+// очередь исходящих команд одного УСК с классами приоритета:
+// внутри класса - FIFO, между классами - по приоритету с учётом старения
+class Usk1OutgoingQueue
+{
+public:
+    Usk1OutgoingQueue();
+    ~Usk1OutgoingQueue();
+
+    void setPriority(const int commandType, const int priority);
+    int priority(const int commandType) const;
+    // каждые msec ожидания поднимают команду на один класс (0 - без старения)
+    void setAgingInterval(const qint64 msec);
+    // срок жизни команд типа в очереди по умолчанию, мс (0 - бессрочно)
+    void setLifetime(const int commandType, const qint64 msec);
+    qint64 lifetime(const int commandType) const;
+    // ограничения очереди одного УСК (0 - без ограничения)
+    void setLimits(const int maxCommands, const int maxBytes);
+    int maxCommands() const;
+    int maxBytes() const;
+    void setOverflowPolicy(const int policy);
+    int overflowPolicy() const;
+    // ограничения суммарно по всем очередям процесса (0 - без ограничения);
+    // при общем переполнении вытесняются только команды своей очереди
+    static void setGlobalLimits(const int maxCommands, const int maxBytes);
+    static int globalCommands();
+    static int globalBytes();
+
+    // назначает команде приоритет и срок по её типу и запоминает время постановки;
+    // команда с тем же ключом объединения, уже стоящая в очереди, заменяется новой
+    // (новая занимает её место) и возвращается в coalesced;
+    // при переполнении действует политика: вытесненные команды возвращаются в dropped,
+    // а если новой команде места так и не нашлось - возвращается false
+    bool enqueue(const Usk1OutgoingCommandSharedPtr &command, const qint64 now,
+                 Usk1OutgoingCommandSharedPtrList *coalesced = nullptr,
+                 Usk1OutgoingCommandSharedPtrList *dropped = nullptr);
+    Usk1OutgoingCommandSharedPtr dequeue(const qint64 now);
+    // снимает с очереди команду с заданным ключом объединения
+    Usk1OutgoingCommandSharedPtr take(const quint64 coalescingKey);
+    bool isEmpty() const;
+    int count() const;
+    int bytes() const;
+    // сколько команд типа стоит в очереди
+    int countOfType(const int commandType) const;
+    void clear();
+
+private:
+    int effectivePriority(const Usk1OutgoingCommandSharedPtr &command, const qint64 now) const;
+    bool fits(const int commandBytes, const int freedCommands = 0, const int freedBytes = 0) const;
+    // индекс очереди, из которой политика вытесняет команду (-1 - вытеснять нечего)
+    int victimQueue(const int commandPriority) const;
+    void insert(const int queue, const int index, const Usk1OutgoingCommandSharedPtr &command);
+    Usk1OutgoingCommandSharedPtr takeAt(const int queue, const int index);
+
+private:
+    Usk1OutgoingCommandSharedPtrList m_queues[SendUSKv1Namespace::prioritiesCount];
+    int m_priorities[SendUSKv1Namespace::commandTypesCount];
+    qint64 m_lifetimes[SendUSKv1Namespace::commandTypesCount];
+    qint64 m_agingInterval;
+    int m_typeCounts[SendUSKv1Namespace::commandTypesCount];
+    int m_count;
+    int m_bytes;
+    int m_maxCommands;
+    int m_maxBytes;
+    int m_overflowPolicy;
+
+    static QAtomicInt m_globalCommands;
+    static QAtomicInt m_globalBytes;
+    static QAtomicInt m_globalMaxCommands;
+    static QAtomicInt m_globalMaxBytes;
+};
+
+#endif // USK1OUTGOINGQUEUE_H
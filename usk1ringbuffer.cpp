@@ -0,0 +1,65 @@
+#include "usk1ringbuffer.h"
+
+#include <cstring>
+
+Usk1RingBuffer::Usk1RingBuffer() :
+    m_head(0),
+    m_size(0)
+{
+}
+
+int Usk1RingBuffer::size() const
+{
+    return m_size;
+}
+
+bool Usk1RingBuffer::isEmpty() const
+{
+    return m_size == 0;
+}
+
+int Usk1RingBuffer::freeSpace() const
+{
+    return Capacity - m_size;
+}
+
+void Usk1RingBuffer::clear()
+{
+    m_head = 0;
+    m_size = 0;
+}
+
+char *Usk1RingBuffer::writePointer(int &contiguous)
+{
+    const int tail = (m_head + m_size) & (Capacity - 1);
+    contiguous = qMin(freeSpace(), Capacity - tail);
+    return m_data + tail;
+}
+
+void Usk1RingBuffer::commit(const int length)
+{
+    m_size += qMin(length, freeSpace());
+}
+
+char Usk1RingBuffer::at(const int index) const
+{
+    return m_data[(m_head + index) & (Capacity - 1)];
+}
+
+const char *Usk1RingBuffer::peek(const int length, char *scratch) const
+{
+    const int firstPart = Capacity - m_head;
+    if (length <= firstPart) {
+        return m_data + m_head;
+    }
+    memcpy(scratch, m_data + m_head, firstPart);
+    memcpy(scratch + firstPart, m_data, length - firstPart);
+    return scratch;
+}
+
+void Usk1RingBuffer::skip(const int length)
+{
+    const int count = qMin(length, m_size);
+    m_size -= count;
+    m_head = m_size == 0 ? 0 : (m_head + count) & (Capacity - 1);
+}
@@ -0,0 +1,42 @@
+#ifndef USK1RINGBUFFER_H
+#define USK1RINGBUFFER_H
+
+#include <QtGlobal>
+
+// кольцевой буфер приёма фиксированного размера: данные из порта читаются прямо в него,
+// пакеты отдаются разборщику без копирования (кроме пакетов на стыке кольца)
+class Usk1RingBuffer
+{
+public:
+    enum {
+        // степень двойки; при заполнении принятое разбирается посреди чтения,
+        // так что буфер не обязан вмещать всё, что накопил драйвер
+        Capacity = 512
+    };
+
+    Usk1RingBuffer();
+
+    int size() const;
+    bool isEmpty() const;
+    int freeSpace() const;
+    void clear();
+
+    // непрерывный свободный участок для записи, contiguous - его длина
+    char *writePointer(int &contiguous);
+    void commit(const int length);
+
+    char at(const int index) const;
+    // указатель на первые length байт; если они лежат на стыке кольца,
+    // копируются в scratch (не менее length байт)
+    const char *peek(const int length, char *scratch) const;
+    void skip(const int length);
+
+private:
+    Q_DISABLE_COPY(Usk1RingBuffer)
+
+    char m_data[Capacity];
+    int m_head;
+    int m_size;
+};
+
+#endif // USK1RINGBUFFER_H
@@ -0,0 +1,113 @@
+#include "usk1rttestimator.h"
+#include <QRandomGenerator>
+
+// пока нет замеров - прежний фиксированный таймаут
+#define initialTimeout 1500
+#define defaultMinTimeout 100
+#define defaultMaxTimeout 3000
+// дальше удвоение таймаута упирается в верхнюю границу при любых разумных настройках
+#define maxBackoffShift 6
+
+Usk1RttEstimator::Usk1RttEstimator() :
+    m_smoothedRttUs(0),
+    m_rttVariationUs(0),
+    m_hasEstimate(false),
+    m_consecutiveTimeouts(0),
+    m_minTimeout(defaultMinTimeout),
+    m_maxTimeout(defaultMaxTimeout),
+    m_jitter(0)
+{
+}
+
+void Usk1RttEstimator::setBounds(const int minTimeout, const int maxTimeout)
+{
+    if (minTimeout > 0 && maxTimeout >= minTimeout) {
+        m_minTimeout = minTimeout;
+        m_maxTimeout = maxTimeout;
+    }
+}
+
+int Usk1RttEstimator::minTimeout() const
+{
+    return m_minTimeout;
+}
+
+int Usk1RttEstimator::maxTimeout() const
+{
+    return m_maxTimeout;
+}
+
+void Usk1RttEstimator::addSample(const qint64 rttUs)
+{
+    const qint64 sample = qMax<qint64>(0, rttUs);
+    if (!m_hasEstimate) {
+        m_smoothedRttUs = sample;
+        m_rttVariationUs = sample / 2;
+        m_hasEstimate = true;
+        return;
+    }
+    // rttvar = 3/4 rttvar + 1/4 |srtt - r|, srtt = 7/8 srtt + 1/8 r
+    const qint64 delta = m_smoothedRttUs - sample;
+    m_rttVariationUs += ((delta < 0 ? -delta : delta) - m_rttVariationUs) / 4;
+    m_smoothedRttUs += (sample - m_smoothedRttUs) / 8;
+}
+
+void Usk1RttEstimator::onSuccess()
+{
+    m_consecutiveTimeouts = 0;
+    m_jitter = 0;
+}
+
+void Usk1RttEstimator::onTimeout()
+{
+    ++m_consecutiveTimeouts;
+    // до четверти текущего таймаута, чтобы повторы к разным УСК не шли в ногу
+    const int spread = qMax(1, baseTimeout() / 4);
+    m_jitter = QRandomGenerator::global()->bounded(spread);
+}
+
+void Usk1RttEstimator::reset()
+{
+    m_smoothedRttUs = 0;
+    m_rttVariationUs = 0;
+    m_hasEstimate = false;
+    m_consecutiveTimeouts = 0;
+    m_jitter = 0;
+}
+
+bool Usk1RttEstimator::hasEstimate() const
+{
+    return m_hasEstimate;
+}
+
+int Usk1RttEstimator::smoothedRtt() const
+{
+    return m_hasEstimate ? static_cast<int>(m_smoothedRttUs / 1000) : -1;
+}
+
+int Usk1RttEstimator::rttVariation() const
+{
+    return m_hasEstimate ? static_cast<int>(m_rttVariationUs / 1000) : -1;
+}
+
+int Usk1RttEstimator::responseTimeout() const
+{
+    return qMin(m_maxTimeout, baseTimeout() + m_jitter);
+}
+
+int Usk1RttEstimator::consecutiveTimeouts() const
+{
+    return m_consecutiveTimeouts;
+}
+
+int Usk1RttEstimator::baseTimeout() const
+{
+    qint64 timeout = initialTimeout;
+    if (m_hasEstimate) {
+        // srtt + 4 * rttvar, округление вверх до мс
+        timeout = (m_smoothedRttUs + 4 * m_rttVariationUs + 999) / 1000;
+    }
+    timeout = qBound<qint64>(m_minTimeout, timeout, m_maxTimeout);
+    timeout <<= qMin(m_consecutiveTimeouts, maxBackoffShift);
+    return static_cast<int>(qMin<qint64>(timeout, m_maxTimeout));
+}
@@ -0,0 +1,49 @@
+#ifndef USK1RTTESTIMATOR_H
+#define USK1RTTESTIMATOR_H
+
+#include <QtGlobal>
+
+// оценка времени отклика УСК по Джекобсону/Карелсу (как RTO в TCP, RFC 6298):
+// сглаженное RTT и его разброс задают таймаут ожидания отклика,
+// подряд идущие таймауты увеличивают его экспоненциально со случайной добавкой
+class Usk1RttEstimator
+{
+public:
+    Usk1RttEstimator();
+
+    // границы таймаута, мс
+    void setBounds(const int minTimeout, const int maxTimeout);
+    int minTimeout() const;
+    int maxTimeout() const;
+
+    // замер от окончания записи команды до отклика, мкс
+    void addSample(const qint64 rttUs);
+    // отклик получен - откат экспоненциального увеличения
+    void onSuccess();
+    // отклик не получен за таймаут
+    void onTimeout();
+    void reset();
+
+    bool hasEstimate() const;
+    // -1, пока нет ни одного замера
+    int smoothedRtt() const;
+    int rttVariation() const;
+    // таймаут ожидания отклика с учётом неудачных попыток, мс
+    int responseTimeout() const;
+    int consecutiveTimeouts() const;
+
+private:
+    int baseTimeout() const;
+
+private:
+    qint64 m_smoothedRttUs;
+    qint64 m_rttVariationUs;
+    bool m_hasEstimate;
+    int m_consecutiveTimeouts;
+    int m_minTimeout;
+    int m_maxTimeout;
+    // случайная добавка, выбирается заново на каждый таймаут
+    int m_jitter;
+};
+
+#endif // USK1RTTESTIMATOR_H
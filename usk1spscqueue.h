@@ -0,0 +1,70 @@
+#ifndef USK1SPSCQUEUE_H
+#define USK1SPSCQUEUE_H
+
+#include <QAtomicInteger>
+#include <utility>
+
+// кольцевая очередь без блокировок для одного производителя и одного потребителя:
+// производитель двигает только хвост, потребитель - только голову; индексы растут
+// непрерывно, позиция в кольце - младшие биты. Голова и хвост разнесены по разным
+// строкам кэша, чтобы потоки не перебрасывали друг другу одну строку
+template <typename T, int Capacity>
+class Usk1SpscQueue
+{
+    Q_STATIC_ASSERT_X(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    Usk1SpscQueue() :
+        m_head(0),
+        m_tail(0)
+    {
+    }
+
+    // только из потока производителя; при заполненной очереди item не трогается
+    bool push(T &item)
+    {
+        const quint32 tail = m_tail.load();
+        if (tail - m_head.loadAcquire() == static_cast<quint32>(Capacity)) {
+            return false;
+        }
+        m_items[tail & (Capacity - 1)] = std::move(item);
+        m_tail.storeRelease(tail + 1);
+        return true;
+    }
+
+    // только из потока потребителя
+    bool pop(T &item)
+    {
+        const quint32 head = m_head.load();
+        if (head == m_tail.loadAcquire()) {
+            return false;
+        }
+        T &slot = m_items[head & (Capacity - 1)];
+        item = std::move(slot);
+        // ячейка не держит ссылок на разделяемые данные до следующей записи
+        slot = T();
+        m_head.storeRelease(head + 1);
+        return true;
+    }
+
+    // из любого потока; снимок, который может сразу устареть
+    int size() const
+    {
+        return static_cast<int>(m_tail.loadAcquire() - m_head.loadAcquire());
+    }
+
+private:
+    Q_DISABLE_COPY(Usk1SpscQueue)
+
+    enum {
+        CacheLine = 64
+    };
+
+    QAtomicInteger<quint32> m_head;
+    char m_headPadding[CacheLine - sizeof(QAtomicInteger<quint32>)];
+    QAtomicInteger<quint32> m_tail;
+    char m_tailPadding[CacheLine - sizeof(QAtomicInteger<quint32>)];
+    T m_items[Capacity];
+};
+
+#endif // USK1SPSCQUEUE_H
@@ -0,0 +1,121 @@
+#ifndef USK1STATISTICS_H
+#define USK1STATISTICS_H
+
+#include <QtGlobal>
+#include "senduskv1global.h"
+
+// время ожидания команд в очереди одного класса приоритета
+struct Usk1QueueWaitStatistics
+{
+    Usk1QueueWaitStatistics() :
+        commands(0),
+        totalWaitMs(0),
+        maxWaitMs(0)
+    {
+    }
+
+    quint64 commands;
+    qint64 totalWaitMs;
+    qint64 maxWaitMs;
+};
+
+// счётчики канала связи с одним УСК
+struct Usk1LinkStatistics
+{
+    Usk1LinkStatistics() :
+        discardedBytes(0),
+        resyncCount(0),
+        incompleteFrames(0),
+        unmatchedResponses(0),
+        lastRecoveryTimeMs(0),
+        maxRecoveryTimeMs(0),
+        circuitOpenCount(0),
+        probeCount(0),
+        expiredCommands(0),
+        overflowCommands(0),
+        queueHighWaterCommands(0),
+        queueHighWaterBytes(0),
+        resetWaits(0),
+        resetWaitTimeouts(0),
+        lastResetRecoveryMs(0),
+        maxResetRecoveryMs(0),
+        receiveErrorReports(0),
+        pacedCommands(0),
+        maxTransmitGapMs(0),
+        timeSyncsSent(0),
+        timeSyncsSkippedConfirmed(0),
+        timeSyncsSkippedBusy(0)
+    {
+    }
+
+    // байты, отброшенные при поиске границы пакета
+    quint64 discardedBytes;
+    // сколько раз синхронизация по пакетам восстанавливалась после сбоя
+    quint32 resyncCount;
+    // недопринятые пакеты, отброшенные по паузе в потоке (t1.5) или по таймеру (t3.5)
+    quint32 incompleteFrames;
+    // отклики, не относящиеся к передаваемой команде (запоздавшие или пришедшие
+    // раньше, чем УСК мог принять текущую попытку)
+    quint32 unmatchedResponses;
+    // время от последнего принятого байта до сброса недопринятого пакета
+    qint64 lastRecoveryTimeMs;
+    qint64 maxRecoveryTimeMs;
+    // сколько раз УСК признавался недоступным и сколько проб отправлено, пока он молчал
+    quint32 circuitOpenCount;
+    quint32 probeCount;
+    // команды, снятые с очереди по истечении срока
+    quint32 expiredCommands;
+    // команды, отклонённые или вытесненные при переполнении очереди
+    quint32 overflowCommands;
+    // наибольшая глубина очереди с момента создания
+    int queueHighWaterCommands;
+    int queueHighWaterBytes;
+    // ожидания перезапуска после сброса и сколько из них закончились по таймауту
+    quint32 resetWaits;
+    quint32 resetWaitTimeouts;
+    // время от отклика на команду сброса до возобновления отправки
+    qint64 lastResetRecoveryMs;
+    qint64 maxResetRecoveryMs;
+    // сообщения УСК об ошибке приёма
+    quint32 receiveErrorReports;
+    // сколько раз отправка откладывалась ради паузы между командами
+    quint32 pacedCommands;
+    // наибольшая пауза между командами, мс
+    int maxTransmitGapMs;
+    // периодические синхронизации времени: отправленные, пропущенные из-за
+    // недавно подтверждённых часов и отложенные ради исполнительных команд
+    quint32 timeSyncsSent;
+    quint32 timeSyncsSkippedConfirmed;
+    quint32 timeSyncsSkippedBusy;
+    // по классам SendUSKv1Namespace::uskCommandPriorities
+    Usk1QueueWaitStatistics queueWait[SendUSKv1Namespace::prioritiesCount];
+};
+
+// стадия доставки событий (Usk1EventPipeline), суммарно по всем рабочим потокам
+struct Usk1PipelineStatistics
+{
+    Usk1PipelineStatistics() :
+        events(0),
+        wakeups(0),
+        producerStalls(0),
+        queueDepth(0),
+        maxQueueDepth(0),
+        totalLatencyUs(0),
+        maxLatencyUs(0)
+    {
+    }
+
+    // доставленные события и пробуждения потока доставки
+    quint64 events;
+    quint64 wakeups;
+    // сколько раз рабочий поток ждал места в заполненной очереди
+    quint64 producerStalls;
+    // глубина очередей сейчас и наибольшая, замеченная при выборке одной очереди
+    int queueDepth;
+    int maxQueueDepth;
+    // от постановки события в очередь до его доставки
+    qint64 totalLatencyUs;
+    qint64 maxLatencyUs;
+};
+
+#endif // USK1STATISTICS_H
@@ -0,0 +1,275 @@
+#include "usk1timerwheel.h"
+
+#include <QThreadStorage>
+#include <QTimerEvent>
+
+Usk1WheelTimer::Usk1WheelTimer() :
+    m_prev(nullptr),
+    m_next(nullptr),
+    m_wheel(nullptr),
+    m_client(nullptr),
+    m_expires(0)
+{
+}
+
+Usk1WheelTimer::~Usk1WheelTimer()
+{
+    stop();
+}
+
+void Usk1WheelTimer::start(const int msec, Usk1TimerWheelClient *client)
+{
+    stop();
+    m_client = client;
+    Usk1TimerWheel::forCurrentThread()->add(this, msec);
+}
+
+void Usk1WheelTimer::stop()
+{
+    if (m_wheel) {
+        m_wheel->remove(this);
+    }
+}
+
+bool Usk1WheelTimer::isActive() const
+{
+    return m_wheel != nullptr;
+}
+
+void Usk1WheelTimer::unlink()
+{
+    m_prev->m_next = m_next;
+    m_next->m_prev = m_prev;
+    m_prev = nullptr;
+    m_next = nullptr;
+}
+
+
+Usk1TimerWheel *Usk1TimerWheel::forCurrentThread()
+{
+    static QThreadStorage<Usk1TimerWheel *> wheels;
+    if (!wheels.hasLocalData()) {
+        wheels.setLocalData(new Usk1TimerWheel());
+    }
+    return wheels.localData();
+}
+
+Usk1TimerWheel::Usk1TimerWheel(QObject *parent) :
+    QObject(parent),
+    m_currentTick(0),
+    m_wakeupTick(0),
+    m_activeTimers(0),
+    m_wakeups(0),
+    m_firedTimers(0),
+    m_inAdvance(false)
+{
+    for (Usk1WheelTimer &slot : m_root) {
+        initSlot(slot);
+    }
+    for (int level = 0; level < Levels; ++level) {
+        for (Usk1WheelTimer &slot : m_levels[level]) {
+            initSlot(slot);
+        }
+    }
+    m_clock.start();
+}
+
+Usk1TimerWheel::~Usk1TimerWheel()
+{
+    // таймеры, пережившие колесо, просто считаются остановленными
+    auto detachAll = [](Usk1WheelTimer &slot) {
+        while (slot.m_next != &slot) {
+            Usk1WheelTimer *timer = slot.m_next;
+            timer->unlink();
+            timer->m_wheel = nullptr;
+        }
+    };
+    for (Usk1WheelTimer &slot : m_root) {
+        detachAll(slot);
+    }
+    for (int level = 0; level < Levels; ++level) {
+        for (Usk1WheelTimer &slot : m_levels[level]) {
+            detachAll(slot);
+        }
+    }
+}
+
+int Usk1TimerWheel::activeTimers() const
+{
+    return m_activeTimers;
+}
+
+quint64 Usk1TimerWheel::wakeups() const
+{
+    return m_wakeups;
+}
+
+quint64 Usk1TimerWheel::firedTimers() const
+{
+    return m_firedTimers;
+}
+
+void Usk1TimerWheel::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() != m_tickTimer.timerId()) {
+        QObject::timerEvent(event);
+        return;
+    }
+    ++m_wakeups;
+    m_tickTimer.stop();
+    m_wakeupTick = 0;
+    advance();
+    scheduleWakeup();
+}
+
+void Usk1TimerWheel::add(Usk1WheelTimer *timer, const int msec)
+{
+    const quint64 current = now();
+    if (m_activeTimers == 0) {
+        // колесо стояло - догонять нечего
+        m_currentTick = current;
+    }
+    // ячейка текущего тика уже отработана
+    timer->m_expires = qMax(current + qMax(0, msec), m_currentTick + 1);
+    timer->m_wheel = this;
+    insert(timer);
+    ++m_activeTimers;
+    if (!m_inAdvance && (m_wakeupTick == 0 || timer->m_expires < m_wakeupTick)) {
+        scheduleWakeup();
+    }
+}
+
+void Usk1TimerWheel::remove(Usk1WheelTimer *timer)
+{
+    timer->unlink();
+    timer->m_wheel = nullptr;
+    if (--m_activeTimers == 0 && !m_inAdvance) {
+        m_tickTimer.stop();
+        m_wakeupTick = 0;
+    }
+}
+
+void Usk1TimerWheel::insert(Usk1WheelTimer *timer)
+{
+    const quint64 delta = timer->m_expires - m_currentTick;
+    if (delta < RootSlots) {
+        append(m_root[timer->m_expires & (RootSlots - 1)], timer);
+        return;
+    }
+    for (int level = 0; level < Levels; ++level) {
+        const int shift = RootBits + level * LevelBits;
+        const quint64 range = Q_UINT64_C(1) << (shift + LevelBits);
+        if (delta < range || level == Levels - 1) {
+            // дальше верхнего уровня - в его последнюю ячейку, при переносе разложится заново
+            const quint64 expires = qMin(timer->m_expires, m_currentTick + range - 1);
+            append(m_levels[level][(expires >> shift) & (LevelSlots - 1)], timer);
+            return;
+        }
+    }
+}
+
+void Usk1TimerWheel::cascade(const int level, const int index)
+{
+    Usk1WheelTimer &slot = m_levels[level][index];
+    if (slot.m_next == &slot) {
+        return;
+    }
+    // сначала снимаем всю ячейку: запись с дальним сроком может вернуться в неё же
+    Usk1WheelTimer pending;
+    initSlot(pending);
+    pending.m_next = slot.m_next;
+    pending.m_prev = slot.m_prev;
+    pending.m_next->m_prev = &pending;
+    pending.m_prev->m_next = &pending;
+    initSlot(slot);
+    while (pending.m_next != &pending) {
+        Usk1WheelTimer *timer = pending.m_next;
+        timer->unlink();
+        insert(timer);
+    }
+}
+
+void Usk1TimerWheel::advance()
+{
+    m_inAdvance = true;
+    const quint64 target = now();
+    while (m_currentTick < target && m_activeTimers > 0) {
+        ++m_currentTick;
+        const int index = m_currentTick & (RootSlots - 1);
+        if (index == 0) {
+            // оборот нижнего колеса - переносим вниз очередную ячейку каждого уровня
+            for (int level = 0; level < Levels; ++level) {
+                const int levelIndex = (m_currentTick >> (RootBits + level * LevelBits)) & (LevelSlots - 1);
+                cascade(level, levelIndex);
+                if (levelIndex != 0) {
+                    break;
+                }
+            }
+        }
+        Usk1WheelTimer &slot = m_root[index];
+        if (slot.m_next == &slot) {
+            continue;
+        }
+        // наступившие сроки снимаем разом, обработчики могут взводить и останавливать таймеры
+        Usk1WheelTimer due;
+        initSlot(due);
+        due.m_next = slot.m_next;
+        due.m_prev = slot.m_prev;
+        due.m_next->m_prev = &due;
+        due.m_prev->m_next = &due;
+        initSlot(slot);
+        while (due.m_next != &due) {
+            Usk1WheelTimer *timer = due.m_next;
+            timer->unlink();
+            timer->m_wheel = nullptr;
+            --m_activeTimers;
+            ++m_firedTimers;
+            timer->m_client->wheelTimerEvent(timer);
+        }
+    }
+    if (m_activeTimers == 0) {
+        m_currentTick = target;
+    }
+    m_inAdvance = false;
+}
+
+void Usk1TimerWheel::scheduleWakeup()
+{
+    if (m_activeTimers == 0) {
+        m_tickTimer.stop();
+        m_wakeupTick = 0;
+        return;
+    }
+    // ближайшая непустая ячейка нижнего колеса, но не дальше его оборота,
+    // на котором в него переносятся записи верхних уровней
+    quint64 tick = m_currentTick + 1;
+    while ((tick & (RootSlots - 1)) != 0) {
+        const Usk1WheelTimer &slot = m_root[tick & (RootSlots - 1)];
+        if (slot.m_next != &slot) {
+            break;
+        }
+        ++tick;
+    }
+    m_wakeupTick = tick;
+    const quint64 current = now();
+    m_tickTimer.start(tick > current ? static_cast<int>(tick - current) : 0, Qt::PreciseTimer, this);
+}
+
+quint64 Usk1TimerWheel::now() const
+{
+    return static_cast<quint64>(m_clock.elapsed());
+}
+
+void Usk1TimerWheel::initSlot(Usk1WheelTimer &slot)
+{
+    slot.m_prev = &slot;
+    slot.m_next = &slot;
+}
+
+void Usk1TimerWheel::append(Usk1WheelTimer &slot, Usk1WheelTimer *timer)
+{
+    timer->m_prev = slot.m_prev;
+    timer->m_next = &slot;
+    slot.m_prev->m_next = timer;
+    slot.m_prev = timer;
+}
@@ -0,0 +1,107 @@
+#ifndef USK1TIMERWHEEL_H
+#define USK1TIMERWHEEL_H
+
+#include <QObject>
+#include <QBasicTimer>
+#include <QElapsedTimer>
+
+class Usk1TimerWheel;
+class Usk1WheelTimer;
+
+// получатель срабатываний таймеров колеса
+class Usk1TimerWheelClient
+{
+public:
+    virtual ~Usk1TimerWheelClient() {}
+    virtual void wheelTimerEvent(Usk1WheelTimer *timer) = 0;
+};
+
+// одноразовый таймер на колесе потока, в котором запущен;
+// запуск, перезапуск и остановка - O(1), без обращения к таймерам Qt
+class Usk1WheelTimer
+{
+public:
+    Usk1WheelTimer();
+    ~Usk1WheelTimer();
+
+    void start(const int msec, Usk1TimerWheelClient *client);
+    void stop();
+    bool isActive() const;
+
+private:
+    Q_DISABLE_COPY(Usk1WheelTimer)
+    friend class Usk1TimerWheel;
+
+    void unlink();
+
+    Usk1WheelTimer *m_prev;
+    Usk1WheelTimer *m_next;
+    Usk1TimerWheel *m_wheel;
+    Usk1TimerWheelClient *m_client;
+    // тик (мс по часам колеса), в который таймер срабатывает
+    quint64 m_expires;
+};
+
+// иерархическое колесо таймеров (Varghese/Lauck, как таймеры ядра Linux):
+// 256 ячеек по 1 мс и три уровня по 64 ячейки, записи верхних уровней
+// переносятся вниз при обороте нижнего. Одно колесо на поток; колесо само
+// будится одним таймером Qt не чаще, чем есть ближайшие сроки, и за
+// пробуждение отрабатывает все наступившие сроки разом
+class Usk1TimerWheel : public QObject
+{
+    Q_OBJECT
+public:
+    enum {
+        RootBits = 8,
+        LevelBits = 6,
+        RootSlots = 1 << RootBits,
+        LevelSlots = 1 << LevelBits,
+        Levels = 3
+    };
+
+    // колесо текущего потока (создаётся при первом обращении, удаляется с потоком)
+    static Usk1TimerWheel *forCurrentThread();
+
+    explicit Usk1TimerWheel(QObject *parent = 0);
+    ~Usk1TimerWheel();
+
+    int activeTimers() const;
+    // сколько раз колесо будилось и сколько таймеров сработало
+    quint64 wakeups() const;
+    quint64 firedTimers() const;
+
+protected:
+    void timerEvent(QTimerEvent *event);
+
+private:
+    friend class Usk1WheelTimer;
+
+    void add(Usk1WheelTimer *timer, const int msec);
+    void remove(Usk1WheelTimer *timer);
+    void insert(Usk1WheelTimer *timer);
+    void cascade(const int level, const int index);
+    void advance();
+    void scheduleWakeup();
+    quint64 now() const;
+
+    static void initSlot(Usk1WheelTimer &slot);
+    static void append(Usk1WheelTimer &slot, Usk1WheelTimer *timer);
+
+private:
+    // ячейки - кольцевые списки с заголовком-заглушкой
+    Usk1WheelTimer m_root[RootSlots];
+    Usk1WheelTimer m_levels[Levels][LevelSlots];
+    QElapsedTimer m_clock;
+    QBasicTimer m_tickTimer;
+    // все сроки до m_currentTick включительно отработаны
+    quint64 m_currentTick;
+    // когда колесо разбудит таймер Qt (0 - не взведён)
+    quint64 m_wakeupTick;
+    int m_activeTimers;
+    quint64 m_wakeups;
+    quint64 m_firedTimers;
+    // пока отрабатываются сроки, пробуждение назначается один раз в конце
+    bool m_inAdvance;
+};
+
+#endif // USK1TIMERWHEEL_H
@@ -0,0 +1,67 @@
+#include "usk1timesyncscheduler.h"
+
+#include <QDateTime>
+#include <QThreadStorage>
+
+// 2^32 / золотое сечение
+#define goldenRatioStep 0x9e3779b9u
+
+Usk1TimeSyncScheduler *Usk1TimeSyncScheduler::forCurrentThread()
+{
+    static QThreadStorage<Usk1TimeSyncScheduler *> schedulers;
+    if (!schedulers.hasLocalData()) {
+        schedulers.setLocalData(new Usk1TimeSyncScheduler());
+    }
+    return schedulers.localData();
+}
+
+Usk1TimeSyncScheduler::Usk1TimeSyncScheduler() :
+    m_phase(0),
+    m_textValid(false),
+    m_textBuilds(0)
+{
+}
+
+int Usk1TimeSyncScheduler::nextPhase(const int period)
+{
+    m_phase += goldenRatioStep;
+    return static_cast<int>((static_cast<quint64>(m_phase) * qMax(0, period)) >> 32);
+}
+
+const Usk1TimeSyncScheduler::TimeText &Usk1TimeSyncScheduler::timeText(const qint64 epochSecond, const int offsetFromUtc)
+{
+    if (m_textValid && m_text.epochSecond == epochSecond && m_text.offsetFromUtc == offsetFromUtc) {
+        return m_text;
+    }
+    const QDateTime dateTime = QDateTime::fromMSecsSinceEpoch(epochSecond * 1000, Qt::OffsetFromUTC, offsetFromUtc);
+    const QDate date = dateTime.date();
+    const QTime time = dateTime.time();
+    quint8 *text = m_text.bytes;
+    putTwoDigits(text, date.day());
+    text[2] = '/';
+    putTwoDigits(text + 3, date.month());
+    text[5] = '/';
+    text[6] = static_cast<quint8>('0' + date.year() % 10);
+    text[7] = ' ';
+    putTwoDigits(text + 8, time.hour());
+    text[10] = ':';
+    putTwoDigits(text + 11, time.minute());
+    text[13] = ':';
+    putTwoDigits(text + 14, time.second());
+    m_text.epochSecond = epochSecond;
+    m_text.offsetFromUtc = offsetFromUtc;
+    m_textValid = true;
+    ++m_textBuilds;
+    return m_text;
+}
+
+quint64 Usk1TimeSyncScheduler::textBuilds() const
+{
+    return m_textBuilds;
+}
+
+void Usk1TimeSyncScheduler::putTwoDigits(quint8 *text, const int value)
+{
+    text[0] = static_cast<quint8>('0' + value / 10 % 10);
+    text[1] = static_cast<quint8>('0' + value % 10);
+}
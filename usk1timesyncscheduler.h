@@ -0,0 +1,48 @@
+#ifndef USK1TIMESYNCSCHEDULER_H
+#define USK1TIMESYNCSCHEDULER_H
+
+#include <QtGlobal>
+
+// общий для УСК рабочего потока планировщик синхронизации времени:
+// раздаёт УСК смещения внутри периода, чтобы синхронизации не шли залпом,
+// и строит текст времени для кадра один раз на секунду для всех УСК
+class Usk1TimeSyncScheduler
+{
+public:
+    enum {
+        TextSize = 16
+    };
+
+    // "дд/ММ/г чч:мм:сс" в CP1251 (только ASCII)
+    struct TimeText {
+        quint8 bytes[TextSize];
+        qint64 epochSecond;
+        int offsetFromUtc;
+    };
+
+    // планировщик текущего потока (создаётся при первом обращении, удаляется с потоком)
+    static Usk1TimeSyncScheduler *forCurrentThread();
+
+    Usk1TimeSyncScheduler();
+
+    // смещение первой периодической синхронизации очередного УСК, мс из [0, period):
+    // последовательность золотого сечения равномерно покрывает период при любом числе УСК
+    int nextPhase(const int period);
+    // текст для секунды от начала эпохи в зоне со смещением от UTC offsetFromUtc, с
+    const TimeText &timeText(const qint64 epochSecond, const int offsetFromUtc);
+    // сколько раз текст времени строился заново
+    quint64 textBuilds() const;
+
+private:
+    Q_DISABLE_COPY(Usk1TimeSyncScheduler)
+
+    static void putTwoDigits(quint8 *text, const int value);
+
+private:
+    quint32 m_phase;
+    TimeText m_text;
+    bool m_textValid;
+    quint64 m_textBuilds;
+};
+
+#endif // USK1TIMESYNCSCHEDULER_H
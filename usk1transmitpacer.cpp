@@ -0,0 +1,50 @@
+#include "usk1transmitpacer.h"
+
+// около длительности одного пакета на 9600 бод
+#define defaultInitialGap 30
+#define defaultMaxGap 1000
+#define defaultDecreaseStep 2
+
+Usk1TransmitPacer::Usk1TransmitPacer() :
+    m_gap(0),
+    m_initialGap(defaultInitialGap),
+    m_maxGap(defaultMaxGap),
+    m_decreaseStep(defaultDecreaseStep)
+{
+}
+
+void Usk1TransmitPacer::setBounds(const int initialGap, const int maxGap)
+{
+    if (initialGap > 0 && maxGap >= initialGap) {
+        m_initialGap = initialGap;
+        m_maxGap = maxGap;
+        m_gap = qMin(m_gap, m_maxGap);
+    }
+}
+
+void Usk1TransmitPacer::setDecreaseStep(const int msec)
+{
+    if (msec > 0) {
+        m_decreaseStep = msec;
+    }
+}
+
+void Usk1TransmitPacer::onReceiveError()
+{
+    m_gap = m_gap == 0 ? m_initialGap : qMin(m_gap * 2, m_maxGap);
+}
+
+void Usk1TransmitPacer::onCleanResponse()
+{
+    m_gap = qMax(0, m_gap - m_decreaseStep);
+}
+
+void Usk1TransmitPacer::reset()
+{
+    m_gap = 0;
+}
+
+int Usk1TransmitPacer::gap() const
+{
+    return m_gap;
+}
@@ -0,0 +1,35 @@
+#ifndef USK1TRANSMITPACER_H
+#define USK1TRANSMITPACER_H
+
+#include <QtGlobal>
+
+// темп передачи команд одному УСК по схеме AIMD (как окно TCP):
+// сообщение УСК об ошибке приёма увеличивает паузу между командами в разы,
+// каждый чистый отклик уменьшает её на постоянный шаг
+class Usk1TransmitPacer
+{
+public:
+    Usk1TransmitPacer();
+
+    // пауза после первой ошибки и её верхняя граница, мс
+    void setBounds(const int initialGap, const int maxGap);
+    // уменьшение паузы за каждый чистый отклик, мс
+    void setDecreaseStep(const int msec);
+
+    // УСК сообщил об ошибке приёма
+    void onReceiveError();
+    // получен отклик на команду, отправленную с первой попытки
+    void onCleanResponse();
+    void reset();
+
+    // текущая минимальная пауза между командами, мс (0 - без ограничения)
+    int gap() const;
+
+private:
+    int m_gap;
+    int m_initialGap;
+    int m_maxGap;
+    int m_decreaseStep;
+};
+
+#endif // USK1TRANSMITPACER_H
@@ -0,0 +1,59 @@
+#ifndef USK1WIN1251_H
+#define USK1WIN1251_H
+
+#include <QString>
+
+// работа с текстом УСК (Windows-1251) напрямую по байтам, без QTextCodec
+class Usk1Win1251
+{
+public:
+    // байтовая сигнатура в CP1251, уже приведённая к нижнему регистру
+    struct Signature {
+        const char *bytes;
+        int length;
+    };
+
+    template<int N>
+    static Q_DECL_CONSTEXPR Signature signature(const char (&bytes)[N]) {
+        return Signature{bytes, N - 1};
+    }
+
+    static uchar toLower(const char ch) {
+        return m_lowerCaseTable[static_cast<uchar>(ch)];
+    }
+    static bool isSpace(const char ch) {
+        return m_charClassTable[static_cast<uchar>(ch)] & spaceClass;
+    }
+    // \w в терминах QRegExp: буква, цифра или '_'
+    static bool isWordChar(const char ch) {
+        return m_charClassTable[static_cast<uchar>(ch)] & wordClass;
+    }
+    // аналог QString(ch).toInt(): для не цифры - 0
+    static int digitValue(const char ch) {
+        return ch >= '0' && ch <= '9' ? ch - '0' : 0;
+    }
+
+    // сравнение без учёта регистра с сигнатурой, начиная с позиции pos
+    static bool matchesAt(const char *data, const int size, const int pos, const Signature &signature);
+    static bool startsWith(const char *data, const int size, const Signature &signature);
+    // сравнение без учёта регистра и пробельных символов по краям
+    static bool equalsTrimmed(const char *data, const int size, const Signature &signature);
+
+    // CP1251 -> UTF-16, ASCII-участки копируются без табличного перекодирования
+    static QString toUnicode(const char *data, const int size);
+    // UTF-16 -> CP1251 в буфер вызывающего (не более capacity байт),
+    // непредставимые символы заменяются на '?'; возвращает число записанных байт
+    static int fromUnicode(const QString &text, char *buffer, const int capacity);
+
+private:
+    enum {
+        spaceClass = 0x01,
+        wordClass = 0x02
+    };
+
+    static const uchar m_lowerCaseTable[256];
+    static const uchar m_charClassTable[256];
+    static const ushort m_unicodeTable[256];
+};
+
+#endif // USK1WIN1251_H